@@ -1,29 +1,49 @@
 #include "qabstractrequest.h"
+#include "qhttparena_p.h"
 #include "qhttpconnection_p.h"
+#include "qhttpheaders_p.h"
+#include "qhttpserversettings_p.h"
 
+#include <QtCore/QAtomicInteger>
 #include <QtCore/QHash>
-#include <QtNetwork/QHostAddress>
 
 class QAbstractRequest::Private
 {
 public:
     explicit Private(QHttpConnection *connection);
+    ~Private();
+
+    void useArena(QHttpArena *arena);
 
     QHttpConnection *connection;
+    QHttpArena *arena;
+    // made when it is asked for the first time
     QUuid uuid;
-    QString remoteAddress;
-    QHash<QByteArray, QByteArray> rawHeaders;
+    QHttpHeaders rawHeaders;
     QList<QNetworkCookie> cookies;
 };
 
 QAbstractRequest::Private::Private(QHttpConnection *connection)
     : connection(connection)
-    , uuid(QUuid::createUuid())
-    , remoteAddress(connection->peerAddress().toString())
+    , arena(0)
 {
 
 }
 
+QAbstractRequest::Private::~Private()
+{
+    if (arena)
+        arena->deref();
+}
+
+void QAbstractRequest::Private::useArena(QHttpArena *arena)
+{
+    if (this->arena)
+        return;
+    this->arena = arena;
+    arena->ref();
+}
+
 QAbstractRequest::QAbstractRequest(QHttpConnection *parent)
     : d(new Private(parent))
 {
@@ -40,29 +60,71 @@ QHttpConnection *QAbstractRequest::connection()
     return d->connection;
 }
 
+static QBasicAtomicInteger<quint64> requestCounter = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+static QUuid sequentialUuid()
+{
+    static const QUuid prefix = QUuid::createUuid();
+    quint64 n = requestCounter.fetchAndAddRelaxed(1) + 1;
+    return QUuid(prefix.data1, prefix.data2, prefix.data3
+                 , uchar(n >> 56), uchar(n >> 48), uchar(n >> 40), uchar(n >> 32)
+                 , uchar(n >> 24), uchar(n >> 16), uchar(n >> 8), uchar(n));
+}
+
 const QUuid &QAbstractRequest::uuid() const
 {
+    if (d->uuid.isNull()) {
+        if (d->connection && d->connection->settings()->sequentialRequestIds)
+            d->uuid = sequentialUuid();
+        else
+            d->uuid = QUuid::createUuid();
+    }
     return d->uuid;
 }
 
 const QString &QAbstractRequest::remoteAddress() const
 {
-    return d->remoteAddress;
+    static const QString none;
+    return d->connection ? d->connection->remoteAddress() : none;
 }
 
 bool QAbstractRequest::hasRawHeader(const QByteArray &headerName) const
 {
-    return d->rawHeaders.contains(headerName.toLower());
+    return d->rawHeaders.contains(headerName);
 }
 
 QByteArray QAbstractRequest::rawHeader(const QByteArray &headerName) const
 {
-    return d->rawHeaders.value(headerName.toLower());
+    return d->rawHeaders.value(headerName);
+}
+
+QList<QByteArray> QAbstractRequest::rawHeaderValues(const QByteArray &headerName) const
+{
+    return d->rawHeaders.values(headerName);
 }
 
+// names are lower case, as they were when the headers were kept in a hash by lower case name
 QList<QByteArray> QAbstractRequest::rawHeaderList() const
 {
-    return d->rawHeaders.keys();
+    QList<QByteArray> ret = d->rawHeaders.names();
+    for (int i = 0; i < ret.size(); i++)
+        ret[i] = ret.at(i).toLower();
+    return ret;
+}
+
+int QAbstractRequest::rawHeaderCount() const
+{
+    return d->rawHeaders.size();
+}
+
+QLatin1String QAbstractRequest::rawHeaderNameAt(int i) const
+{
+    return QLatin1String(d->rawHeaders.nameData(i), d->rawHeaders.nameLength(i));
+}
+
+QLatin1String QAbstractRequest::rawHeaderValueAt(int i) const
+{
+    return QLatin1String(d->rawHeaders.valueData(i), d->rawHeaders.valueLength(i));
 }
 
 const QList<QNetworkCookie> &QAbstractRequest::cookies() const
@@ -70,17 +132,50 @@ const QList<QNetworkCookie> &QAbstractRequest::cookies() const
     return d->cookies;
 }
 
-QHash<QByteArray, QByteArray> QAbstractRequest::rawHeaders() const
+const QHttpHeaders &QAbstractRequest::rawHeaders() const
+{
+    return d->rawHeaders;
+}
+
+QHttpHeaders &QAbstractRequest::rawHeaders()
 {
     return d->rawHeaders;
 }
 
 void QAbstractRequest::insertRawHeader(const QByteArray &key, const QByteArray& value)
 {
-    d->rawHeaders.insert(key, value);
+    d->rawHeaders.append(key, value);
+}
+
+void QAbstractRequest::takeRawHeaders(QAbstractRequest *other)
+{
+    d->rawHeaders.swap(other->d->rawHeaders);
+    other->d->rawHeaders.clear();
+    d->cookies.swap(other->d->cookies);
+    other->d->cookies.clear();
+    // the headers may point into the arena of the other request
+    if (other->d->arena)
+        d->useArena(other->d->arena);
+}
+
+char *QAbstractRequest::allocate(int size)
+{
+    d->useArena(d->connection->arena());
+    return d->arena->allocate(size);
 }
 
 void QAbstractRequest::addCookie(const QList<QNetworkCookie> &cookie)
 {
     d->cookies.append(cookie);
 }
+
+void QAbstractRequest::recycleRequest()
+{
+    d->rawHeaders.clear();
+    d->cookies.clear();
+    if (d->arena) {
+        d->arena->deref();
+        d->arena = 0;
+    }
+    d->uuid = QUuid();
+}
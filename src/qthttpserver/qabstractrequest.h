@@ -2,6 +2,7 @@
 #define QABSTRACTREQUEST_H
 
 #include "qthttpserverglobal.h"
+#include <QtCore/QString>
 #include <QtCore/QUrl>
 #include <QtCore/QUuid>
 #include <QtNetwork/QNetworkCookie>
@@ -9,6 +10,7 @@
 QT_BEGIN_NAMESPACE
 
 class QHttpConnection;
+class QHttpHeaders;
 class QNetworkCookie;
 
 class Q_HTTPSERVER_EXPORT QAbstractRequest
@@ -21,14 +23,32 @@ public:
     const QUuid &uuid() const;
     const QString &remoteAddress() const;
     bool hasRawHeader(const QByteArray &headerName) const;
+    // a header received more than once is returned joined by commas
     QByteArray rawHeader(const QByteArray &headerName) const;
+    QList<QByteArray> rawHeaderValues(const QByteArray &headerName) const;
+    // the names of the headers in lower case, each once
     QList<QByteArray> rawHeaderList() const;
+
+    // every header line in the order it was received. the strings point into the
+    // request and stay valid as long as it does
+    int rawHeaderCount() const;
+    QLatin1String rawHeaderNameAt(int i) const;
+    QLatin1String rawHeaderValueAt(int i) const;
+
     const QList<QNetworkCookie> &cookies() const;
 
 protected:
-    QHash<QByteArray, QByteArray> rawHeaders() const;
+    const QHttpHeaders &rawHeaders() const;
+    QHttpHeaders &rawHeaders();
     void insertRawHeader(const QByteArray &key, const QByteArray& value);
+    // moves the headers and cookies of other to this request
+    void takeRawHeaders(QAbstractRequest *other);
+    // memory from the connection's arena that lives as long as the request,
+    // 0 when the arena is full
+    char *allocate(int size);
     void addCookie(const QList<QNetworkCookie> &cookie);
+    // forgets the headers, cookies and arena memory so the object can carry another request
+    void recycleRequest();
 
 private:
     class Private;
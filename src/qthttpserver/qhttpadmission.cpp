@@ -0,0 +1,180 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "qhttpadmission_p.h"
+
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#include "qhttpserversettings_p.h"
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+QHttpAdmission::QHttpAdmission(const QHttpServerSettings *settings, QObject *parent)
+    : QObject(parent)
+    , settings(settings)
+{
+}
+
+// the count is raised first and taken back when it went over the limit,
+// so two threads can not both take the last place
+static bool acquire(QAtomicInt &count, int limit)
+{
+    int previous = count.fetchAndAddOrdered(1);
+    if (limit > 0 && previous >= limit) {
+        count.deref();
+        return false;
+    }
+    return true;
+}
+
+bool QHttpAdmission::admitConnection(QHttpLoad *threadLoad)
+{
+    if (!acquire(threadLoad->connections, settings->maxConnectionsPerThread))
+        return false;
+    const int limit = settings->maxConnections;
+    int count = load.connections.fetchAndAddOrdered(1) + 1;
+    if (limit > 0 && count > limit) {
+        releaseConnection(threadLoad);
+        return false;
+    }
+    if (count == limit)
+        emit fullChanged();
+    return true;
+}
+
+void QHttpAdmission::releaseConnection(QHttpLoad *threadLoad)
+{
+    threadLoad->connections.deref();
+    // also taking back a refused connection may be what drops the count below the limit
+    const int limit = settings->maxConnections;
+    if (load.connections.fetchAndAddOrdered(-1) == limit && limit > 0)
+        emit fullChanged();
+}
+
+void QHttpAdmission::refuseConnection(qintptr socketDescriptor)
+{
+    shedConnectionCount.ref();
+    QByteArray response = unavailableResponse();
+#if defined(Q_OS_UNIX)
+    // the socket is new, its send buffer takes the response without blocking
+    int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+    ::send(socketDescriptor, response.constData(), response.size(), flags);
+    ::shutdown(socketDescriptor, SHUT_WR);
+    // closing with unread data sends RST, which can drop the 503 before the client reads it
+    char discard[4096];
+    for (int drained = 0; drained < 64 * 1024; ) {
+        ssize_t length = ::recv(socketDescriptor, discard, sizeof(discard), MSG_DONTWAIT);
+        if (length <= 0)
+            break;
+        drained += length;
+    }
+    ::close(socketDescriptor);
+#else
+    QTcpSocket *socket = new QTcpSocket;
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    socket->write(response);
+    socket->disconnectFromHost();
+#endif
+}
+
+bool QHttpAdmission::admitRequest(QHttpLoad *threadLoad)
+{
+    if (acquire(load.requests, settings->maxInFlightRequests)) {
+        if (acquire(threadLoad->requests, settings->maxInFlightRequestsPerThread))
+            return true;
+        load.requests.deref();
+    }
+    shedRequestCount.ref();
+    return false;
+}
+
+void QHttpAdmission::releaseRequest(QHttpLoad *threadLoad)
+{
+    threadLoad->requests.deref();
+    load.requests.deref();
+}
+
+bool QHttpAdmission::isFull() const
+{
+    return settings->maxConnections > 0 && load.connections.load() >= settings->maxConnections;
+}
+
+// the state is read again on every call, so notifications that arrive out of order do no harm
+void QHttpAdmission::updateAccepting(QTcpServer *server) const
+{
+    if (!server->isListening())
+        return;
+    if (settings->overloadPolicy == QHttpServer::PauseAccepting && isFull())
+        server->pauseAccepting();
+    else
+        server->resumeAccepting();
+}
+
+void QHttpAdmission::limitsChanged()
+{
+    emit fullChanged();
+}
+
+int QHttpAdmission::connections() const
+{
+    return load.connections.load();
+}
+
+int QHttpAdmission::requests() const
+{
+    return load.requests.load();
+}
+
+quint64 QHttpAdmission::shedConnections() const
+{
+    return shedConnectionCount.load();
+}
+
+quint64 QHttpAdmission::shedRequests() const
+{
+    return shedRequestCount.load();
+}
+
+QByteArray QHttpAdmission::unavailableResponse() const
+{
+    QByteArray response = "HTTP/1.1 503 Service Unavailable\r\n";
+    if (settings->retryAfter > 0)
+        response += "Retry-After: " + QByteArray::number(settings->retryAfter) + "\r\n";
+    response += "Connection: close\r\nContent-Length: 0\r\n\r\n";
+    return response;
+}
@@ -0,0 +1,90 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPADMISSION_H
+#define QHTTPADMISSION_H
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QObject>
+
+class QTcpServer;
+class QHttpServerSettings;
+
+// connections and requests in flight on one thread or on the whole server
+struct QHttpLoad
+{
+    QAtomicInt connections;
+    QAtomicInt requests;
+};
+
+// admits connections and requests while the server and the thread that handles them
+// are within the limits of the settings. shared by the threads of a server
+class QHttpAdmission : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QHttpAdmission(const QHttpServerSettings *settings, QObject *parent = 0);
+
+    // reserves a connection on the server and on the thread, false when a limit is reached
+    bool admitConnection(QHttpLoad *threadLoad);
+    void releaseConnection(QHttpLoad *threadLoad);
+    // answers a connection that was not admitted with 503 and closes it. what the client
+    // has sent already is drained so the close does not reset the connection, what arrives
+    // later still does. the 503 is best-effort
+    void refuseConnection(qintptr socketDescriptor);
+
+    // a request is in flight from its head being read until its reply is finished
+    bool admitRequest(QHttpLoad *threadLoad);
+    void releaseRequest(QHttpLoad *threadLoad);
+
+    // the server has maxConnections open
+    bool isFull() const;
+    // pauses or resumes a listening server depending on isFull() and the overload policy
+    void updateAccepting(QTcpServer *server) const;
+    void limitsChanged();
+
+    int connections() const;
+    int requests() const;
+    quint64 shedConnections() const;
+    quint64 shedRequests() const;
+
+    QByteArray unavailableResponse() const;
+
+signals:
+    // the server reached maxConnections or dropped below it, the signal may come
+    // more often than that and from any thread
+    void fullChanged();
+
+private:
+    const QHttpServerSettings *settings;
+    QHttpLoad load;
+    QAtomicInteger<quint64> shedConnectionCount;
+    QAtomicInteger<quint64> shedRequestCount;
+    Q_DISABLE_COPY(QHttpAdmission)
+};
+
+#endif // QHTTPADMISSION_H
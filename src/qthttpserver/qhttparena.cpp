@@ -0,0 +1,112 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "qhttparena_p.h"
+
+#include <stdlib.h>
+
+QHttpArena::QHttpArena(int blockSize, int maxSize)
+    : blockSize(blockSize)
+    , maxSize(maxSize)
+    , size(0)
+    , used(blockSize)
+    , users(0)
+    , released(false)
+{
+}
+
+QHttpArena::~QHttpArena()
+{
+    for (int i = 0; i < blocks.size(); i++)
+        free(blocks.at(i));
+}
+
+// memory is 8 byte aligned and valid until the arena is reset
+char *QHttpArena::allocate(int length)
+{
+    length = (length + 7) & ~7;
+    if (length > blockSize) {
+        // large data gets a block of its own, the current one stays in use
+        if (size + length > maxSize)
+            return 0;
+        char *block = static_cast<char *>(malloc(length));
+        if (!block)
+            return 0;
+        size += length;
+        blocks.prepend(block);
+        return block;
+    }
+    if (used + length > blockSize) {
+        if (size + blockSize > maxSize)
+            return 0;
+        char *block = static_cast<char *>(malloc(blockSize));
+        if (!block)
+            return 0;
+        size += blockSize;
+        blocks.append(block);
+        used = 0;
+    }
+    char *ret = blocks.last() + used;
+    used += length;
+    return ret;
+}
+
+void QHttpArena::ref()
+{
+    users++;
+}
+
+void QHttpArena::deref()
+{
+    if (--users > 0)
+        return;
+    if (released)
+        delete this;
+    else
+        reset();
+}
+
+void QHttpArena::release()
+{
+    released = true;
+    if (users == 0)
+        delete this;
+}
+
+// keeps the current block for the next request
+void QHttpArena::reset()
+{
+    if (blocks.isEmpty())
+        return;
+    for (int i = 0; i < blocks.size() - 1; i++)
+        free(blocks.at(i));
+    char *last = blocks.last();
+    blocks.clear();
+    blocks.append(last);
+    size = blockSize;
+    used = 0;
+}
@@ -0,0 +1,63 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPARENA_H
+#define QHTTPARENA_H
+
+#include <QtCore/QVarLengthArray>
+
+// bump allocator for the data of the requests on one connection. requests ref it when
+// they allocate and the memory is reused once the last of them is gone, which on a
+// keep-alive connection happens between requests. allocate() returns 0 once maxSize
+// bytes are in use so that pipelined requests can not grow it without bounds.
+// the connection releases it and the last user deletes it
+class QHttpArena
+{
+public:
+    explicit QHttpArena(int blockSize = 8192, int maxSize = 256 * 1024);
+
+    char *allocate(int length);
+
+    void ref();
+    void deref();
+    void release();
+
+private:
+    ~QHttpArena();
+    void reset();
+
+    int blockSize;
+    int maxSize;
+    int size;
+    QVarLengthArray<char *, 4> blocks;
+    int used;
+    int users;
+    bool released;
+    Q_DISABLE_COPY(QHttpArena)
+};
+
+#endif // QHTTPARENA_H
@@ -0,0 +1,370 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "qhttpcompressor_p.h"
+#include "qhttpserver_logging.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QList>
+#include <QtCore/QThreadStorage>
+
+#include <limits.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef QHS_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef QHS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+class QHttpDeflatePool
+{
+public:
+    ~QHttpDeflatePool();
+
+    static const int maxStreams = 8;
+    QList<z_stream *> streams[2];
+};
+
+QHttpDeflatePool::~QHttpDeflatePool()
+{
+    for (int i = 0; i < 2; i++) {
+        foreach (z_stream *stream, streams[i]) {
+            deflateEnd(stream);
+            delete stream;
+        }
+    }
+}
+
+static QThreadStorage<QHttpDeflatePool *> deflatePools;
+
+static QHttpDeflatePool *deflatePool()
+{
+    if (!deflatePools.hasLocalData())
+        deflatePools.setLocalData(new QHttpDeflatePool);
+    return deflatePools.localData();
+}
+
+QHttpCompressor::QHttpCompressor(Encoding encoding)
+    : encoding(encoding)
+    , stream(0)
+{
+}
+
+QHttpCompressor::~QHttpCompressor()
+{
+    end();
+}
+
+bool QHttpCompressor::begin(int level, int strategy)
+{
+    end();
+    // in the order of QHttpReply::CompressionStrategy
+    static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED };
+    strategy = strategies[strategy];
+
+    QList<z_stream *> &streams = deflatePool()->streams[encoding];
+    if (!streams.isEmpty()) {
+        stream = streams.takeLast();
+        if (deflateReset(stream) == Z_OK && deflateParams(stream, level, strategy) == Z_OK)
+            return true;
+        deflateEnd(stream);
+        delete stream;
+    }
+
+    stream = new z_stream;
+    memset(stream, 0, sizeof(z_stream));
+    // 31 adds the gzip wrapper, 15 is the zlib format used for "deflate"
+    int status = deflateInit2(stream, level, Z_DEFLATED, encoding == Gzip ? 31 : 15, 8, strategy);
+    if (status != Z_OK) {
+        qhsWarning() << "deflateInit2 failed:" << status;
+        delete stream;
+        stream = 0;
+        return false;
+    }
+    return true;
+}
+
+bool QHttpCompressor::encode(const char *data, int length, Flush flush, QByteArray *out)
+{
+    if (!stream)
+        return false;
+
+    static const int flushModes[] = { Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FINISH };
+    stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream->avail_in = length;
+
+    for (;;) {
+        int used = out->size();
+        int room = qMax<int>(deflateBound(stream, stream->avail_in), 16 * 1024);
+        out->resize(used + room);
+        stream->next_out = reinterpret_cast<Bytef *>(out->data() + used);
+        stream->avail_out = room;
+        int status = deflate(stream, flushModes[flush]);
+        out->resize(used + room - stream->avail_out);
+        if (status == Z_STREAM_ERROR) {
+            qhsWarning() << "data encoding failed:" << status << stream->msg;
+            return false;
+        }
+        // all input is consumed and flushed once deflate leaves output space unused
+        if (flush == Finish ? status == Z_STREAM_END : stream->avail_out != 0)
+            break;
+    }
+    return true;
+}
+
+void QHttpCompressor::end()
+{
+    if (!stream)
+        return;
+    QList<z_stream *> &streams = deflatePool()->streams[encoding];
+    if (streams.length() < QHttpDeflatePool::maxStreams) {
+        streams.append(stream);
+    } else {
+        deflateEnd(stream);
+        delete stream;
+    }
+    stream = 0;
+}
+
+#ifdef QHS_HAVE_BROTLI
+QHttpBrotliEncoder::QHttpBrotliEncoder()
+    : state(0)
+{
+}
+
+QHttpBrotliEncoder::~QHttpBrotliEncoder()
+{
+    end();
+}
+
+bool QHttpBrotliEncoder::begin(int level, int strategy)
+{
+    Q_UNUSED(strategy)
+    end();
+    state = BrotliEncoderCreateInstance(0, 0, 0);
+    if (!state) {
+        qhsWarning() << "BrotliEncoderCreateInstance failed";
+        return false;
+    }
+    // the highest qualities are far too slow for replies that are compressed on the fly
+    BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, level < 0 ? 5 : level);
+    return true;
+}
+
+bool QHttpBrotliEncoder::encode(const char *data, int length, Flush flush, QByteArray *out)
+{
+    if (!state)
+        return false;
+
+    static const BrotliEncoderOperation operations[] = { BROTLI_OPERATION_PROCESS, BROTLI_OPERATION_FLUSH, BROTLI_OPERATION_FINISH };
+    size_t availableIn = length;
+    const uint8_t *nextIn = reinterpret_cast<const uint8_t *>(data);
+
+    for (;;) {
+        int used = out->size();
+        int room = qMax<int>(BrotliEncoderMaxCompressedSize(availableIn), 16 * 1024);
+        out->resize(used + room);
+        size_t availableOut = room;
+        uint8_t *nextOut = reinterpret_cast<uint8_t *>(out->data() + used);
+        bool ok = BrotliEncoderCompressStream(state, operations[flush], &availableIn, &nextIn, &availableOut, &nextOut, 0);
+        out->resize(used + room - availableOut);
+        if (!ok) {
+            qhsWarning() << "data encoding [br] failed";
+            return false;
+        }
+        if (availableIn == 0 && !BrotliEncoderHasMoreOutput(state) && (flush != Finish || BrotliEncoderIsFinished(state)))
+            break;
+    }
+    return true;
+}
+
+void QHttpBrotliEncoder::end()
+{
+    if (!state)
+        return;
+    BrotliEncoderDestroyInstance(state);
+    state = 0;
+}
+#endif
+
+#ifdef QHS_HAVE_ZSTD
+class QHttpZstdPool
+{
+public:
+    ~QHttpZstdPool();
+
+    static const int maxContexts = 8;
+    QList<ZSTD_CCtx *> contexts;
+};
+
+QHttpZstdPool::~QHttpZstdPool()
+{
+    foreach (ZSTD_CCtx *context, contexts) {
+        ZSTD_freeCCtx(context);
+    }
+}
+
+static QThreadStorage<QHttpZstdPool *> zstdPools;
+
+static QHttpZstdPool *zstdPool()
+{
+    if (!zstdPools.hasLocalData())
+        zstdPools.setLocalData(new QHttpZstdPool);
+    return zstdPools.localData();
+}
+
+QHttpZstdEncoder::QHttpZstdEncoder()
+    : context(0)
+{
+}
+
+QHttpZstdEncoder::~QHttpZstdEncoder()
+{
+    end();
+}
+
+bool QHttpZstdEncoder::begin(int level, int strategy)
+{
+    Q_UNUSED(strategy)
+    end();
+    QList<ZSTD_CCtx *> &contexts = zstdPool()->contexts;
+    if (!contexts.isEmpty()) {
+        context = contexts.takeLast();
+        ZSTD_CCtx_reset(context, ZSTD_reset_session_and_parameters);
+    } else {
+        context = ZSTD_createCCtx();
+        if (!context) {
+            qhsWarning() << "ZSTD_createCCtx failed";
+            return false;
+        }
+    }
+    ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+    return true;
+}
+
+bool QHttpZstdEncoder::encode(const char *data, int length, Flush flush, QByteArray *out)
+{
+    if (!context)
+        return false;
+
+    static const ZSTD_EndDirective directives[] = { ZSTD_e_continue, ZSTD_e_flush, ZSTD_e_end };
+    ZSTD_inBuffer input = { data, size_t(length), 0 };
+
+    for (;;) {
+        int used = out->size();
+        int room = qMax<int>(ZSTD_compressBound(input.size - input.pos), 16 * 1024);
+        out->resize(used + room);
+        ZSTD_outBuffer output = { out->data() + used, size_t(room), 0 };
+        size_t remaining = ZSTD_compressStream2(context, &output, &input, directives[flush]);
+        out->resize(used + output.pos);
+        if (ZSTD_isError(remaining)) {
+            qhsWarning() << "data encoding [zstd] failed:" << ZSTD_getErrorName(remaining);
+            return false;
+        }
+        if (flush == NoFlush ? input.pos == input.size : remaining == 0)
+            break;
+    }
+    return true;
+}
+
+void QHttpZstdEncoder::end()
+{
+    if (!context)
+        return;
+    QList<ZSTD_CCtx *> &contexts = zstdPool()->contexts;
+    if (contexts.length() < QHttpZstdPool::maxContexts)
+        contexts.append(context);
+    else
+        ZSTD_freeCCtx(context);
+    context = 0;
+}
+#endif
+
+QHttpCompressionCache::QHttpCompressionCache()
+    : cache(0)
+    , size(0)
+    , hitCount(0)
+    , missCount(0)
+{
+}
+
+qint64 QHttpCompressionCache::maxSize() const
+{
+    QMutexLocker lock(&mutex);
+    return size;
+}
+
+void QHttpCompressionCache::setMaxSize(qint64 maxSize)
+{
+    QMutexLocker lock(&mutex);
+    size = qBound<qint64>(0, maxSize, INT_MAX);
+    cache.setMaxCost(size);
+}
+
+// the digest of the body plus everything that changes the compressed bytes
+QByteArray QHttpCompressionCache::key(const QByteArray &source, const QByteArray &encoding, int level, int strategy)
+{
+    QByteArray ret = QCryptographicHash::hash(source, QCryptographicHash::Sha1);
+    ret.append(encoding);
+    ret.append(char(level));
+    ret.append(char(strategy));
+    return ret;
+}
+
+bool QHttpCompressionCache::find(const QByteArray &key, QByteArray *encoded)
+{
+    QMutexLocker lock(&mutex);
+    QByteArray *entry = cache.object(key);
+    if (!entry) {
+        missCount++;
+        return false;
+    }
+    hitCount++;
+    *encoded = *entry;
+    return true;
+}
+
+void QHttpCompressionCache::insert(const QByteArray &key, const QByteArray &encoded)
+{
+    QMutexLocker lock(&mutex);
+    cache.insert(key, new QByteArray(encoded), encoded.size() + key.size());
+}
+
+quint64 QHttpCompressionCache::hits() const
+{
+    QMutexLocker lock(&mutex);
+    return hitCount;
+}
+
+quint64 QHttpCompressionCache::misses() const
+{
+    QMutexLocker lock(&mutex);
+    return missCount;
+}
@@ -0,0 +1,127 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPCOMPRESSOR_H
+#define QHTTPCOMPRESSOR_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtCore/QMutex>
+
+#include "qhttpcontentencoder.h"
+
+struct z_stream_s;
+
+// incremental gzip/deflate compression. z_streams are kept in a per thread pool
+// and reset for the next reply instead of being initialized every time.
+class QHttpCompressor : public QHttpContentEncoder
+{
+public:
+    enum Encoding {
+        Gzip
+        , Deflate
+    };
+
+    explicit QHttpCompressor(Encoding encoding);
+    ~QHttpCompressor();
+
+    bool begin(int level, int strategy);
+    bool encode(const char *data, int length, Flush flush, QByteArray *out);
+    void end();
+
+private:
+    Encoding encoding;
+    z_stream_s *stream;
+    Q_DISABLE_COPY(QHttpCompressor)
+};
+
+#ifdef QHS_HAVE_BROTLI
+struct BrotliEncoderStateStruct;
+
+class QHttpBrotliEncoder : public QHttpContentEncoder
+{
+public:
+    QHttpBrotliEncoder();
+    ~QHttpBrotliEncoder();
+
+    bool begin(int level, int strategy);
+    bool encode(const char *data, int length, Flush flush, QByteArray *out);
+    void end();
+
+private:
+    BrotliEncoderStateStruct *state;
+    Q_DISABLE_COPY(QHttpBrotliEncoder)
+};
+#endif
+
+#ifdef QHS_HAVE_ZSTD
+struct ZSTD_CCtx_s;
+
+// compression contexts are pooled per thread like the z_streams
+class QHttpZstdEncoder : public QHttpContentEncoder
+{
+public:
+    QHttpZstdEncoder();
+    ~QHttpZstdEncoder();
+
+    bool begin(int level, int strategy);
+    bool encode(const char *data, int length, Flush flush, QByteArray *out);
+    void end();
+
+private:
+    ZSTD_CCtx_s *context;
+    Q_DISABLE_COPY(QHttpZstdEncoder)
+};
+#endif
+
+// compressed bodies of whole replies shared by all connections of a server,
+// least recently used entries are dropped once maxSize bytes are in use
+class QHttpCompressionCache
+{
+public:
+    QHttpCompressionCache();
+
+    qint64 maxSize() const;
+    void setMaxSize(qint64 maxSize);
+
+    static QByteArray key(const QByteArray &source, const QByteArray &encoding, int level, int strategy);
+    bool find(const QByteArray &key, QByteArray *encoded);
+    void insert(const QByteArray &key, const QByteArray &encoded);
+
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    mutable QMutex mutex;
+    QCache<QByteArray, QByteArray> cache;
+    qint64 size;
+    quint64 hitCount;
+    quint64 missCount;
+    Q_DISABLE_COPY(QHttpCompressionCache)
+};
+
+#endif // QHTTPCOMPRESSOR_H
@@ -26,100 +26,372 @@
 
 #include "qhttpconnection_p.h"
 
-#include <QtCore/QTime>
 #include <QtCore/QUrl>
+#include <QtCore/QVector>
+#include <QtNetwork/QHostAddress>
 
+#include "qhttpadmission_p.h"
+#include "qhttparena_p.h"
+#include "qhttpheaders_p.h"
+#include "qhttpscan_p.h"
+#include "qhttpserversettings_p.h"
+#include "qhttpserver_logging.h"
+#include "qhttptimerwheel_p.h"
 #include "qhttprequest.h"
 #include "qhttpreply.h"
 #include "qwebsocket.h"
 
+#include <string.h>
+
+#if defined(Q_OS_UNIX)
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+// Connection is a comma separated list of options which are compared case-insensitively
+static bool hasConnectionOption(const QByteArray &value, const char *option)
+{
+    const int optionLength = strlen(option);
+    const char *p = value.constData();
+    const char *end = p + value.size();
+    while (p < end) {
+        const char *comma = qhsFindChar(p, end, ',');
+        const char *e = comma;
+        while (p < e && (*p == ' ' || *p == '\t'))
+            p++;
+        while (e > p && (e[-1] == ' ' || e[-1] == '\t'))
+            e--;
+        if (QHttpHeaders::equalsIgnoreCase(p, e - p, option, optionLength))
+            return true;
+        p = comma + 1;
+    }
+    return false;
+}
+
+// a reply and what it has written while the replies ahead of it were not complete
+struct QHttpExchange
+{
+    QHttpReply *reply;
+    QByteArray output;
+    // the reply has written everything
+    bool complete;
+    // the connection ends after the reply
+    bool close;
+};
+
 class QHttpConnection::Private : public QObject
 {
     Q_OBJECT
 public:
-    Private(qintptr socketDescriptor, QHttpConnection *parent);
+    Private(qintptr socketDescriptor, const QHttpServerSettings *settings, QHttpLoad *threadLoad, QHttpConnection *parent);
 
-private slots:
-    void upgrade(const QByteArray &to, const QUrl &url, const QHash<QByteArray, QByteArray> &rawHeaders);
-    void requestReady();
-    void replyDone(QObject *);
-    void websocketReady();
+    int exchangeIndex(QHttpReply *reply) const;
+    void sendReplies();
+    void closeIfDone();
+    void newRequest();
+    QHttpReply *newReply();
+    void releaseRequest(QHttpRequest *request);
+    void releaseReply(QHttpReply *reply);
+    void releaseAdmission(QHttpReply *reply);
+    void updateReadTimeout(bool received);
+    void watchWrites();
+    bool isThrottled() const;
 
-private:
-    QHttpConnection *q;
-    int keepAlive;
+public slots:
+    void readyRead();
+    void bytesWritten();
+    void readTimedOut();
+    void writeTimedOut();
+    void websocketReady();
 
 public:
+    // what the connection waits for, each phase has its own timeout
+    enum ReadPhase {
+        WaitForRequest
+        , ReadHead
+        , ReadBody
+        , Handle
+    };
+
+    static const int maxSpares = 4;
+    // pipelined requests are not parsed while this many responses wait to be sent
+    static const int maxExchanges = 16;
+
+    QHttpConnection *q;
+    // requests handed out on this connection
+    int requestCount;
+    // whether the request being read may be followed by another one
+    bool persistent;
+    // the connection is closed once the replies in use are sent
+    bool closing;
+    ReadPhase readPhase;
+    QHttpTimeout readTimeout;
+    QHttpTimeout writeTimeout;
+    // a reply waits for the socket to take more of a file
+    bool writeBlocked;
+    const QHttpServerSettings *settings;
+    QHttpLoad *threadLoad;
+    QHttpArena *arena;
+    // replies in use and the requests they answer
     QMap<QObject*, QHttpRequest*> requestMap;
-    QTime timer;
+    // replies that answer requests over the in-flight limits
+    QList<QHttpReply *> refused;
+    // replies in the order of their requests. the first one writes to the socket
+    QVector<QHttpExchange> exchanges;
+    // the request the received bytes belong to
+    QHttpRequest *reading;
+    // set while readyRead() parses the buffer
+    bool parsing;
+    // readyRead() stopped at maxExchanges, the socket's read buffer holds the client back
+    bool throttled;
+    // finished requests and replies, kept for the next requests of this connection only
+    QList<QHttpRequest *> spareRequests;
+    QList<QHttpReply *> spareReplies;
+    QByteArray buffer;
+    // kept as the socket forgets it once disconnected
+    QHostAddress peerAddress;
+    QString remoteAddress;
 };
 
-QHttpConnection::Private::Private(qintptr socketDescriptor, QHttpConnection *parent)
+QHttpConnection::Private::Private(qintptr socketDescriptor, const QHttpServerSettings *settings, QHttpLoad *threadLoad, QHttpConnection *parent)
     : QObject(parent)
     , q(parent)
-    , keepAlive(100)
+    , requestCount(0)
+    , persistent(false)
+    , closing(false)
+    , readPhase(Handle)
+    , readTimeout(this, "readTimedOut")
+    , writeTimeout(this, "writeTimedOut")
+    , writeBlocked(false)
+    , settings(settings)
+    , threadLoad(threadLoad)
+    , arena(new QHttpArena)
+    , reading(0)
+    , parsing(false)
+    , throttled(false)
 {
     q->setSocketOption(KeepAliveOption, 1);
     q->setSocketDescriptor(socketDescriptor);
+    q->setReadBufferSize(settings->readBufferSize);
+    peerAddress = q->peerAddress();
+    buffer.reserve(4096);
+    connect(q, SIGNAL(readyRead()), this, SLOT(readyRead()));
+    connect(q, SIGNAL(bytesWritten(qint64)), this, SLOT(bytesWritten()));
 
-    QHttpRequest *request = new QHttpRequest(q);
-    connect(request, SIGNAL(ready()), this, SLOT(requestReady()));
-    connect(request, SIGNAL(upgrade(QByteArray, QUrl, QHash<QByteArray, QByteArray>)), this, SLOT(upgrade(QByteArray, QUrl, QHash<QByteArray, QByteArray>)));
+    newRequest();
+    updateReadTimeout(false);
 
-    timer.start();
     connect(q, SIGNAL(disconnected()), q, SLOT(deleteLater()));
 }
 
-void QHttpConnection::Private::upgrade(const QByteArray &to, const QUrl &url, const QHash<QByteArray, QByteArray> &rawHeaders)
+void QHttpConnection::Private::newRequest()
 {
-    QHttpRequest *request = qobject_cast<QHttpRequest *>(sender());
-    disconnect(request, 0, this, 0);
-    request->deleteLater();
-    if (to.toLower() == "websocket") {
-        QWebSocket *socket = new QWebSocket(q, url, rawHeaders);
-        connect(socket, SIGNAL(ready()), this, SLOT(websocketReady()));
-    }
-}
-
-void QHttpConnection::Private::requestReady()
-{
-    QHttpRequest *request = qobject_cast<QHttpRequest *>(sender());
-    disconnect(request, SIGNAL(ready()), this, SLOT(requestReady()));
-    QHttpReply *reply = new QHttpReply(q);
-    connect(reply, SIGNAL(destroyed(QObject *)), this, SLOT(replyDone(QObject*)));
-    requestMap.insert(reply, request);
-    emit q->ready(request, reply);
-
-    if (request->hasRawHeader("Connection")) {
-        if (request->rawHeader("Connection") == QByteArray("Keep-Alive").toLower()) {
-            if (keepAlive > 0) {
-                reply->setRawHeader("Keep-Alive", QString::fromUtf8("timeout=1, max=%1").arg(keepAlive--).toUtf8());
-                reply->setRawHeader("Connection", "Keep-Alive");
-                request = new QHttpRequest(q);
-                connect(request, SIGNAL(ready()), this, SLOT(requestReady()));
-            } else {
-                reply->setRawHeader("Connection", "Close");
-                keepAlive = 0;
-            }
-        } else {
-            reply->setRawHeader("Connection", "Close");
-            keepAlive = 0;
+    if (!spareRequests.isEmpty())
+        reading = spareRequests.takeLast();
+    else
+        reading = new QHttpRequest(q);
+    // a pipelined request may already be waiting in the buffer, readyRead()
+    // goes on with it right away when it is the one that finished the last request
+    if (!buffer.isEmpty() && !parsing)
+        QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
+}
+
+int QHttpConnection::Private::exchangeIndex(QHttpReply *reply) const
+{
+    for (int i = 0; i < exchanges.size(); i++) {
+        if (exchanges.at(i).reply == reply)
+            return i;
+    }
+    return -1;
+}
+
+// writes the output of the complete replies at the front of the queue with one write,
+// the first incomplete reply writes to the socket itself from then on
+void QHttpConnection::Private::sendReplies()
+{
+    QByteArray output;
+    while (!exchanges.isEmpty()) {
+        QHttpExchange &exchange = exchanges.first();
+        if (output.isEmpty())
+            output.swap(exchange.output);
+        else
+            output.append(exchange.output);
+        exchange.output.clear();
+        if (!exchange.complete)
+            break;
+        bool close = exchange.close;
+        exchanges.removeFirst();
+        if (close) {
+            // the replies after it are never sent, the client has to ask again
+            closing = true;
+            persistent = false;
+            reading = 0;
+            exchanges.clear();
         }
-    } else {
-        reply->setRawHeader("Connection", "Close");
-        keepAlive = 0;
     }
+    if (!output.isEmpty())
+        q->write(output);
+    if (!exchanges.isEmpty() && exchanges.first().reply)
+        exchanges.first().reply->startSending();
+    closeIfDone();
+    if (closing)
+        return;
+    if (throttled && !isThrottled()) {
+        throttled = false;
+        QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
+    }
+    updateReadTimeout(false);
+}
+
+void QHttpConnection::Private::closeIfDone()
+{
+    if (closing && exchanges.isEmpty())
+        q->disconnectFromHost();
 }
 
-void QHttpConnection::Private::replyDone(QObject *reply)
+QHttpReply *QHttpConnection::Private::newReply()
 {
-    if (requestMap.contains(reply)) {
-        QHttpRequest *request = requestMap.take(reply);
+    if (!spareReplies.isEmpty())
+        return spareReplies.takeLast();
+    return new QHttpReply(q);
+}
+
+void QHttpConnection::Private::releaseRequest(QHttpRequest *request)
+{
+    if (spareRequests.length() < maxSpares) {
+        request->recycle();
+        spareRequests.append(request);
+    } else {
         request->deleteLater();
     }
-    if (keepAlive == 0 && requestMap.isEmpty()) {
+}
+
+void QHttpConnection::Private::releaseReply(QHttpReply *reply)
+{
+    if (spareReplies.length() < maxSpares) {
+        reply->recycle();
+        spareReplies.append(reply);
+    } else {
+        reply->deleteLater();
+    }
+}
+
+// requests count against the in-flight limits until their reply is finished
+void QHttpConnection::Private::releaseAdmission(QHttpReply *reply)
+{
+    if (!refused.removeOne(reply))
+        settings->admission->releaseRequest(threadLoad);
+}
+
+// the head of a request has to arrive within headerTimeout of its first byte, slow
+// clients can not keep the connection by sending a byte now and then. the body only
+// has to make progress within bodyTimeout and an idle connection is closed after
+// keepAliveTimeout. nothing is timed while the application handles a request
+void QHttpConnection::Private::updateReadTimeout(bool received)
+{
+    ReadPhase phase = Handle;
+    if (throttled) {
+        // the client is not read from, it is not timed either
+    } else if (reading && reading->isWaitingForBody()) {
+        phase = ReadBody;
+    } else if (reading && reading->isWaitingForHead()) {
+        if (!buffer.isEmpty() || q->bytesAvailable() > 0)
+            phase = ReadHead;
+        else if (exchanges.isEmpty())
+            phase = WaitForRequest;
+    }
+
+    if (phase == readPhase && !(phase == ReadBody && received))
+        return;
+    readPhase = phase;
+    int msecs = 0;
+    switch (phase) {
+    case WaitForRequest:
+        msecs = settings->keepAliveTimeout;
+        break;
+    case ReadHead:
+        msecs = settings->headerTimeout;
+        break;
+    case ReadBody:
+        msecs = settings->bodyTimeout;
+        break;
+    case Handle:
+        break;
+    }
+    if (msecs > 0)
+        readTimeout.start(msecs);
+    else
+        readTimeout.stop();
+}
+
+// output that waits in the socket has to drain within writeTimeout of the last progress
+void QHttpConnection::Private::watchWrites()
+{
+    if (!writeTimeout.isActive() && settings->writeTimeout > 0)
+        writeTimeout.start(settings->writeTimeout);
+}
+
+void QHttpConnection::Private::bytesWritten()
+{
+    if (q->bytesToWrite() > 0 || writeBlocked) {
+        if (settings->writeTimeout > 0)
+            writeTimeout.start(settings->writeTimeout);
+    } else {
+        writeTimeout.stop();
+    }
+}
+
+void QHttpConnection::Private::readTimedOut()
+{
+    ReadPhase phase = readPhase;
+    readPhase = Handle;
+    persistent = false;
+    closing = true;
+    reading = 0;
+    if (phase == WaitForRequest) {
         q->disconnectFromHost();
+        return;
     }
+    qhsDebug() << "request from" << q->remoteAddress() << "timed out";
+    // the client gets a reply unless it would be taken for one of the pending ones
+    if (exchanges.isEmpty()) {
+        q->write("HTTP/1.1 408 Request Timeout\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+        q->disconnectFromHost();
+    }
+}
+
+void QHttpConnection::Private::writeTimedOut()
+{
+    if (q->bytesToWrite() == 0 && !writeBlocked)
+        return;
+    qhsDebug() << "client" << q->remoteAddress() << "stopped reading";
+    q->abort();
+}
+
+// the next request waits for its head while too many responses are queued
+bool QHttpConnection::Private::isThrottled() const
+{
+    return exchanges.size() >= maxExchanges && reading && reading->isWaitingForHead();
+}
+
+// pipelined requests are parsed one after the other as long as the buffer holds data
+void QHttpConnection::Private::readyRead()
+{
+    parsing = true;
+    QHttpRequest *request;
+    do {
+        request = reading;
+        if (!request)
+            break;
+        if (isThrottled()) {
+            throttled = true;
+            break;
+        }
+        request->readRequest();
+    } while (reading && reading != request && !buffer.isEmpty());
+    parsing = false;
+    updateReadTimeout(true);
 }
 
 void QHttpConnection::Private::websocketReady()
@@ -129,14 +401,43 @@ void QHttpConnection::Private::websocketReady()
     emit q->ready(socket);
 }
 
-QHttpConnection::QHttpConnection(qintptr socketDescriptor, QObject *parent)
+QHttpConnection::QHttpConnection(qintptr socketDescriptor, const QHttpServerSettings *settings, QHttpLoad *threadLoad, QObject *parent)
     : QTcpSocket(parent)
-    , d(new Private(socketDescriptor, this))
+    , d(new Private(socketDescriptor, settings, threadLoad, this))
 {
 }
 
+const QHttpServerSettings *QHttpConnection::settings() const
+{
+    return d->settings;
+}
+
 QHttpConnection::~QHttpConnection()
 {
+    foreach (QObject *reply, d->requestMap.keys()) {
+        d->releaseAdmission(static_cast<QHttpReply *>(reply));
+    }
+    d->settings->admission->releaseConnection(d->threadLoad);
+    // the objects still in use report their deletion to d, which is deleted before them otherwise
+    d->requestMap.clear();
+    d->exchanges.clear();
+    d->reading = 0;
+    qDeleteAll(findChildren<QHttpReply *>(QString(), Qt::FindDirectChildrenOnly));
+    qDeleteAll(findChildren<QHttpRequest *>(QString(), Qt::FindDirectChildrenOnly));
+    // requests that are still alive keep the arena until they are deleted
+    d->arena->release();
+}
+
+const QString &QHttpConnection::remoteAddress()
+{
+    if (d->remoteAddress.isNull())
+        d->remoteAddress = d->peerAddress.toString();
+    return d->remoteAddress;
+}
+
+QHttpArena *QHttpConnection::arena() const
+{
+    return d->arena;
 }
 
 const QHttpRequest *QHttpConnection::requestFor(QHttpReply *reply)
@@ -144,4 +445,294 @@ const QHttpRequest *QHttpConnection::requestFor(QHttpReply *reply)
     return d->requestMap.value(reply);
 }
 
+void QHttpConnection::requestReady(QHttpRequest *request)
+{
+    QHttpReply *reply = d->newReply();
+    d->requestMap.insert(reply, request);
+    QHttpExchange exchange;
+    exchange.reply = reply;
+    exchange.complete = false;
+    exchange.close = false;
+    d->exchanges.append(exchange);
+    d->requestCount++;
+
+    // decided before the request is handed out as the reply may be closed right away.
+    // HTTP/1.1 connections are persistent unless the client asks otherwise, HTTP/1.0 ones
+    // only when the client asks for it
+    const QHttpServerSettings *settings = d->settings;
+    QByteArray options = request->rawHeader("Connection");
+    bool http10 = request->httpVersion() == "HTTP/1.0";
+    bool keepAlive = http10 ? hasConnectionOption(options, "keep-alive") : !hasConnectionOption(options, "close");
+    if (settings->keepAliveTimeout <= 0)
+        keepAlive = false;
+    if (settings->maxRequestsPerConnection > 0 && d->requestCount >= settings->maxRequestsPerConnection)
+        keepAlive = false;
+
+    d->persistent = keepAlive && !d->closing;
+    if (d->persistent) {
+        if (http10)
+            reply->setRawHeader("Connection", "keep-alive");
+        QByteArray parameters = "timeout=" + QByteArray::number((settings->keepAliveTimeout + 999) / 1000);
+        if (settings->maxRequestsPerConnection > 0)
+            parameters += ", max=" + QByteArray::number(settings->maxRequestsPerConnection - d->requestCount);
+        reply->setRawHeader("Keep-Alive", parameters);
+    } else {
+        reply->setRawHeader("Connection", "close");
+        d->closing = true;
+    }
+
+    // over the limits the request is answered here, the application never sees it
+    if (!settings->admission->admitRequest(d->threadLoad)) {
+        d->refused.append(reply);
+        reply->setStatus(503);
+        if (settings->retryAfter > 0)
+            reply->setRawHeader("Retry-After", QByteArray::number(settings->retryAfter));
+        reply->close();
+        return;
+    }
+
+    emit ready(request, reply);
+}
+
+// the next request is read once the body of the current one has been received
+void QHttpConnection::requestFinished(QHttpRequest *request)
+{
+    if (d->reading == request)
+        d->reading = 0;
+    // the reply is done already, the request can not be reused from its own stack
+    if (!d->requestMap.key(request))
+        request->deleteLater();
+    if (d->persistent)
+        d->newRequest();
+}
+
+void QHttpConnection::requestUpgrade(QHttpRequest *request, const QByteArray &to, const QUrl &url)
+{
+    if (d->reading == request)
+        d->reading = 0;
+    request->deleteLater();
+    if (to.toLower() == "websocket") {
+        QWebSocket *socket = new QWebSocket(this, url, request);
+        connect(socket, SIGNAL(ready()), d, SLOT(websocketReady()));
+    }
+}
+
+void QHttpConnection::replyFinished(QHttpReply *reply)
+{
+    if (d->requestMap.contains(reply))
+        d->releaseAdmission(reply);
+    QHttpRequest *request = d->requestMap.take(reply);
+    d->releaseReply(reply);
+    // a reply which is not sent yet keeps its output in the queue
+    int i = d->exchangeIndex(reply);
+    if (i >= 0)
+        d->exchanges[i].reply = 0;
+    // a request still reading its body is released when it is finished
+    if (request && request != d->reading)
+        d->releaseRequest(request);
+    if (d->closing)
+        d->closeIfDone();
+    else
+        d->updateReadTimeout(false);
+}
+
+void QHttpConnection::refuseRequest(QHttpRequest *request, const QByteArray &status)
+{
+    if (d->reading == request)
+        d->reading = 0;
+    d->persistent = false;
+    d->closing = true;
+    QHttpExchange exchange;
+    exchange.reply = 0;
+    exchange.output = "HTTP/1.1 " + status + "\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    exchange.complete = true;
+    exchange.close = true;
+    d->exchanges.append(exchange);
+    if (d->exchanges.size() == 1)
+        d->sendReplies();
+}
+
+void QHttpConnection::sendContinue()
+{
+    QHttpExchange exchange;
+    exchange.reply = 0;
+    exchange.output = "HTTP/1.1 100 Continue\r\n\r\n";
+    exchange.complete = true;
+    exchange.close = false;
+    d->exchanges.append(exchange);
+    if (d->exchanges.size() == 1)
+        d->sendReplies();
+}
+
+void QHttpConnection::requestDestroyed(QHttpRequest *request)
+{
+    if (d->reading == request)
+        d->reading = 0;
+    QMap<QObject*, QHttpRequest*>::iterator it = d->requestMap.begin();
+    while (it != d->requestMap.end()) {
+        if (it.value() == request)
+            it.value() = 0;
+        ++it;
+    }
+    d->spareRequests.removeOne(request);
+}
+
+void QHttpConnection::replyDestroyed(QHttpReply *reply)
+{
+    d->spareReplies.removeOne(reply);
+    if (!d->requestMap.contains(reply))
+        return;
+    d->releaseAdmission(reply);
+    QHttpRequest *request = d->requestMap.take(reply);
+    if (request && request != d->reading)
+        request->deleteLater();
+    // the client would take the next reply for the one that is missing
+    int i = d->exchangeIndex(reply);
+    if (i >= 0) {
+        QHttpExchange &exchange = d->exchanges[i];
+        exchange.reply = 0;
+        if (!exchange.complete) {
+            exchange.complete = true;
+            exchange.close = true;
+            if (i == 0)
+                d->sendReplies();
+        }
+    }
+    d->closeIfDone();
+}
+
+void QHttpConnection::readStateChanged()
+{
+    d->updateReadTimeout(false);
+}
+
+void QHttpConnection::setWriteBlocked(bool writeBlocked)
+{
+    d->writeBlocked = writeBlocked;
+    d->bytesWritten();
+}
+
+qint64 QHttpConnection::writeData(const char *data, qint64 length)
+{
+    qint64 ret = QTcpSocket::writeData(data, length);
+    if (ret > 0)
+        d->watchWrites();
+    return ret;
+}
+
+bool QHttpConnection::isSending(QHttpReply *reply) const
+{
+    return !d->exchanges.isEmpty() && d->exchanges.first().reply == reply;
+}
+
+void QHttpConnection::writeReply(QHttpReply *reply, const QByteArray &head, const char *data, qint64 length)
+{
+    if (isSending(reply)) {
+        writev(head, data, length);
+        return;
+    }
+    // replies that are not queued any more are not sent
+    int i = d->exchangeIndex(reply);
+    if (i < 0)
+        return;
+    QByteArray &output = d->exchanges[i].output;
+    output.append(head);
+    output.append(data, length);
+}
+
+void QHttpConnection::writeReply(QHttpReply *reply, const char *data, qint64 length)
+{
+    if (isSending(reply))
+        write(data, length);
+    else
+        writeReply(reply, QByteArray(), data, length);
+}
+
+void QHttpConnection::endReply(QHttpReply *reply, bool close)
+{
+    int i = d->exchangeIndex(reply);
+    if (i < 0)
+        return;
+    QHttpExchange &exchange = d->exchanges[i];
+    exchange.complete = true;
+    // the application may end the connection with Connection: close on the reply
+    exchange.close = close || hasConnectionOption(reply->rawHeader("Connection"), "close");
+    if (i == 0)
+        d->sendReplies();
+}
+
+const QByteArray &QHttpConnection::buffer() const
+{
+    return d->buffer;
+}
+
+int QHttpConnection::fillBuffer()
+{
+    qint64 available = bytesAvailable();
+    if (available <= 0)
+        return 0;
+    int size = d->buffer.size();
+    d->buffer.resize(size + available);
+    qint64 length = read(d->buffer.data() + size, available);
+    if (length < 0)
+        length = 0;
+    d->buffer.resize(size + length);
+    return length;
+}
+
+void QHttpConnection::consume(int length)
+{
+    if (length >= d->buffer.size())
+        d->buffer.resize(0);
+    else if (length > 0)
+        d->buffer.remove(0, length);
+}
+
+QByteArray QHttpConnection::takeBuffer(int maxLength)
+{
+    if (maxLength < 0 || maxLength > d->buffer.size())
+        maxLength = d->buffer.size();
+    QByteArray ret = d->buffer.left(maxLength);
+    consume(maxLength);
+    return ret;
+}
+
+qint64 QHttpConnection::writev(const QByteArray &head, const char *data, qint64 length)
+{
+    qint64 sent = 0;
+#if defined(Q_OS_UNIX)
+    // bytes already in the write buffer have to go first
+    if (bytesToWrite() == 0 && state() == ConnectedState) {
+        struct iovec vectors[2];
+        vectors[0].iov_base = const_cast<char *>(head.constData());
+        vectors[0].iov_len = head.length();
+        vectors[1].iov_base = const_cast<char *>(data);
+        vectors[1].iov_len = length;
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = vectors;
+        message.msg_iovlen = length > 0 ? 2 : 1;
+#if defined(MSG_NOSIGNAL)
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        ssize_t ret;
+        do {
+            ret = ::sendmsg(socketDescriptor(), &message, flags);
+        } while (ret < 0 && errno == EINTR);
+        // errors are reported by the buffered write below
+        if (ret > 0)
+            sent = ret;
+    }
+#endif
+    qint64 headSent = qMin<qint64>(sent, head.length());
+    qint64 dataSent = sent - headSent;
+    if (headSent < head.length())
+        write(head.constData() + headSent, head.length() - headSent);
+    if (dataSent < length)
+        write(data + dataSent, length - dataSent);
+    return head.length() + length;
+}
+
 #include "qhttpconnection.moc"
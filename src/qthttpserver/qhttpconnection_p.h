@@ -32,20 +32,69 @@
 class QHttpRequest;
 class QHttpReply;
 class QWebSocket;
+class QHttpServerSettings;
+class QHttpArena;
+struct QHttpLoad;
+class QUrl;
 
 class QHttpConnection : public QTcpSocket
 {
     Q_OBJECT
 public:
-    explicit QHttpConnection(qintptr socketDescriptor, QObject *parent = 0);
+    // the connection is admitted on threadLoad already and releases it when deleted
+    explicit QHttpConnection(qintptr socketDescriptor, const QHttpServerSettings *settings, QHttpLoad *threadLoad, QObject *parent = 0);
     ~QHttpConnection();
 
+    const QHttpServerSettings *settings() const;
+    // the peer address as text, formatted once per connection
+    const QString &remoteAddress();
+    QHttpArena *arena() const;
+
     const QHttpRequest *requestFor(QHttpReply *reply);
 
+    // called by the requests and replies of the connection
+    void requestReady(QHttpRequest *request);
+    void requestFinished(QHttpRequest *request);
+    void requestUpgrade(QHttpRequest *request, const QByteArray &to, const QUrl &url);
+    void replyFinished(QHttpReply *reply);
+    // answers a request that is not handed out with an empty response, in order with the
+    // replies ahead of it. the connection is closed after it
+    void refuseRequest(QHttpRequest *request, const QByteArray &status);
+    // sends 100 Continue for the request being read once the replies ahead of it are sent
+    void sendContinue();
+    void requestDestroyed(QHttpRequest *request);
+    void replyDestroyed(QHttpReply *reply);
+
+    // bytes received from the socket and not consumed by a request yet
+    const QByteArray &buffer() const;
+    int fillBuffer();
+    void consume(int length);
+    QByteArray takeBuffer(int maxLength = -1);
+
+    // sends head and data with one gather write when nothing else is queued,
+    // what the kernel does not take is queued like write() does
+    qint64 writev(const QByteArray &head, const char *data, qint64 length);
+
+    // replies are sent in the order of their requests. what a reply writes while the
+    // replies ahead of it are not complete is held back and sent with them
+    bool isSending(QHttpReply *reply) const;
+    void writeReply(QHttpReply *reply, const QByteArray &head, const char *data, qint64 length);
+    void writeReply(QHttpReply *reply, const char *data, qint64 length);
+    // the reply has written everything, close ends the connection after it
+    void endReply(QHttpReply *reply, bool close);
+
+    // a request was paused or resumed
+    void readStateChanged();
+    // a reply waits for the socket to become writable, the write timeout applies meanwhile
+    void setWriteBlocked(bool writeBlocked);
+
 signals:
     void ready(QHttpRequest *request, QHttpReply *reply);
     void ready(QWebSocket *socket);
 
+protected:
+    qint64 writeData(const char *data, qint64 length);
+
 private:
     class Private;
     Private *d;
@@ -0,0 +1,61 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPCONTENTENCODER_H
+#define QHTTPCONTENTENCODER_H
+
+#include <QtCore/QByteArray>
+
+#include "qthttpserverglobal.h"
+
+QT_BEGIN_NAMESPACE
+
+// compresses one reply body for a Content-Encoding, see QHttpServer::setContentEncoder().
+// an encoder is created for each compressed reply and used on the connection's thread
+class Q_HTTPSERVER_EXPORT QHttpContentEncoder
+{
+public:
+    enum Flush {
+        NoFlush
+        , SyncFlush
+        , Finish
+    };
+
+    virtual ~QHttpContentEncoder() {}
+
+    // level is the reply's compressionLevel, -1 picks the encoder's default.
+    // strategy is a QHttpReply::CompressionStrategy that encoders may ignore
+    virtual bool begin(int level, int strategy) = 0;
+    // appends the encoded data to out. SyncFlush makes everything written so far
+    // decodable and Finish ends the stream
+    virtual bool encode(const char *data, int length, Flush flush, QByteArray *out) = 0;
+    virtual void end() = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif // QHTTPCONTENTENCODER_H
@@ -0,0 +1,258 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "qhttpheaders_p.h"
+
+#include <string.h>
+
+#define QHS_KNOWN_HEADER(name) { name, int(sizeof(name)) - 1 }
+
+// in the order of KnownHeader
+const QHttpHeaders::KnownName QHttpHeaders::knownNames[KnownHeaderCount] = {
+    QHS_KNOWN_HEADER("Accept-Encoding"),
+    QHS_KNOWN_HEADER("Connection"),
+    QHS_KNOWN_HEADER("Content-Disposition"),
+    QHS_KNOWN_HEADER("Content-Encoding"),
+    QHS_KNOWN_HEADER("Content-Length"),
+    QHS_KNOWN_HEADER("Content-Type"),
+    QHS_KNOWN_HEADER("Cookie"),
+    QHS_KNOWN_HEADER("Expect"),
+    QHS_KNOWN_HEADER("Host"),
+    QHS_KNOWN_HEADER("Keep-Alive"),
+    QHS_KNOWN_HEADER("Transfer-Encoding"),
+    QHS_KNOWN_HEADER("Upgrade"),
+    QHS_KNOWN_HEADER("Vary"),
+};
+
+#undef QHS_KNOWN_HEADER
+
+QHttpHeaders::QHttpHeaders()
+{
+    memset(indexes, -1, sizeof(indexes));
+}
+
+QHttpHeaders::KnownHeader QHttpHeaders::knownHeader(const char *name, int length)
+{
+    for (int i = 0; i < KnownHeaderCount; i++) {
+        if (equalsIgnoreCase(name, length, knownNames[i].name, knownNames[i].length))
+            return KnownHeader(i);
+    }
+    return UnknownHeader;
+}
+
+bool QHttpHeaders::equalsIgnoreCase(const char *a, int aLength, const char *b, int bLength)
+{
+    if (aLength != bLength)
+        return false;
+    for (int i = 0; i < aLength; i++) {
+        char x = a[i];
+        char y = b[i];
+        if (x == y)
+            continue;
+        // only ASCII letters may differ, in case
+        x |= 0x20;
+        if (x != (y | 0x20) || x < 'a' || x > 'z')
+            return false;
+    }
+    return true;
+}
+
+QByteArray QHttpHeaders::value(KnownHeader header) const
+{
+    int index = indexes[header];
+    return index < 0 ? QByteArray() : joined(index);
+}
+
+QByteArray QHttpHeaders::value(const QByteArray &name) const
+{
+    int index = indexOf(name);
+    return index < 0 ? QByteArray() : joined(index);
+}
+
+QList<QByteArray> QHttpHeaders::values(const QByteArray &name) const
+{
+    QList<QByteArray> ret;
+    for (int i = indexOf(name); i >= 0; i = nextIndex(i))
+        ret.append(valueAt(i));
+    return ret;
+}
+
+void QHttpHeaders::insert(const QByteArray &name, const QByteArray &value)
+{
+    int index = indexOf(name);
+    if (index >= 0)
+        removeAll(index);
+    append(name.constData(), name.length(), value, knownHeader(name.constData(), name.length()));
+}
+
+void QHttpHeaders::insert(KnownHeader header, const QByteArray &value)
+{
+    if (indexes[header] >= 0)
+        removeAll(indexes[header]);
+    append(knownNames[header].name, knownNames[header].length, value, header);
+}
+
+void QHttpHeaders::append(const QByteArray &name, const QByteArray &value)
+{
+    append(name.constData(), name.length(), value, knownHeader(name.constData(), name.length()));
+}
+
+void QHttpHeaders::remove(KnownHeader header)
+{
+    if (indexes[header] >= 0)
+        removeAll(indexes[header]);
+}
+
+void QHttpHeaders::remove(const QByteArray &name)
+{
+    int index = indexOf(name);
+    if (index >= 0)
+        removeAll(index);
+}
+
+void QHttpHeaders::clear()
+{
+    storage.clear();
+    entries.clear();
+    memset(indexes, -1, sizeof(indexes));
+}
+
+void QHttpHeaders::setStorage(const QByteArray &data)
+{
+    clear();
+    storage = data;
+}
+
+void QHttpHeaders::appendSpan(int name, int nameLength, int value, int valueLength)
+{
+    Entry entry;
+    entry.name = name;
+    entry.nameLength = nameLength;
+    entry.value = value;
+    entry.valueLength = valueLength;
+    entry.known = knownHeader(storage.constData() + name, nameLength);
+    if (entry.known != UnknownHeader && indexes[entry.known] < 0)
+        indexes[entry.known] = entries.size();
+    entries.append(entry);
+}
+
+QList<QByteArray> QHttpHeaders::names() const
+{
+    QList<QByteArray> ret;
+    for (int i = 0; i < entries.size(); i++) {
+        // the first entry of each name only
+        int first = indexOf(QByteArray::fromRawData(nameData(i), nameLength(i)));
+        if (first == i)
+            ret.append(nameAt(i));
+    }
+    return ret;
+}
+
+void QHttpHeaders::swap(QHttpHeaders &other)
+{
+    qSwap(storage, other.storage);
+    QVarLengthArray<Entry, 16> swapped = entries;
+    entries = other.entries;
+    other.entries = swapped;
+    for (int i = 0; i < KnownHeaderCount; i++)
+        qSwap(indexes[i], other.indexes[i]);
+}
+
+int QHttpHeaders::indexOf(const QByteArray &name) const
+{
+    KnownHeader known = knownHeader(name.constData(), name.length());
+    if (known != UnknownHeader)
+        return indexes[known];
+    for (int i = 0; i < entries.size(); i++) {
+        const Entry &entry = entries.at(i);
+        if (entry.known == UnknownHeader && equalsIgnoreCase(nameData(i), entry.nameLength, name.constData(), name.length()))
+            return i;
+    }
+    return -1;
+}
+
+int QHttpHeaders::nextIndex(int index) const
+{
+    const Entry &entry = entries.at(index);
+    for (int i = index + 1; i < entries.size(); i++) {
+        if (entries.at(i).known != entry.known)
+            continue;
+        if (entry.known != UnknownHeader || equalsIgnoreCase(nameData(i), nameLength(i), nameData(index), entry.nameLength))
+            return i;
+    }
+    return -1;
+}
+
+QByteArray QHttpHeaders::joined(int index) const
+{
+    int next = nextIndex(index);
+    if (next < 0)
+        return valueAt(index);
+
+    const char *separator = entries.at(index).known == Cookie ? "; " : ", ";
+    QByteArray ret = valueAt(index);
+    for (; next >= 0; next = nextIndex(next)) {
+        ret.append(separator);
+        ret.append(valueData(next), valueLength(next));
+    }
+    return ret;
+}
+
+void QHttpHeaders::append(const char *name, int nameLength, const QByteArray &value, KnownHeader known)
+{
+    Entry entry;
+    entry.name = storage.size();
+    entry.nameLength = nameLength;
+    storage.append(name, nameLength);
+    entry.value = storage.size();
+    entry.valueLength = value.length();
+    storage.append(value);
+    entry.known = known;
+    if (known != UnknownHeader && indexes[known] < 0)
+        indexes[known] = entries.size();
+    entries.append(entry);
+}
+
+// removes every entry with the name of the one at index
+void QHttpHeaders::removeAll(int index)
+{
+    for (int i = entries.size() - 1; i > index; i--) {
+        if (entries.at(i).known == entries.at(index).known && equalsIgnoreCase(nameData(i), nameLength(i), nameData(index), nameLength(index)))
+            entries.remove(i);
+    }
+    entries.remove(index);
+    updateIndexes();
+}
+
+void QHttpHeaders::updateIndexes()
+{
+    memset(indexes, -1, sizeof(indexes));
+    for (int i = entries.size() - 1; i >= 0; i--) {
+        if (entries.at(i).known != UnknownHeader)
+            indexes[entries.at(i).known] = i;
+    }
+}
@@ -0,0 +1,130 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPHEADERS_H
+#define QHTTPHEADERS_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QVarLengthArray>
+
+// headers of a request or a reply in the order they were added. a name may appear more
+// than once. names and values are spans into one storage buffer, for requests that is
+// the head as it was received. names are compared case-insensitively without allocating
+// and the headers the server looks at itself have a slot each
+class QHttpHeaders
+{
+public:
+    enum KnownHeader {
+        UnknownHeader = -1
+        , AcceptEncoding
+        , Connection
+        , ContentDisposition
+        , ContentEncoding
+        , ContentLength
+        , ContentType
+        , Cookie
+        , Expect
+        , Host
+        , KeepAlive
+        , TransferEncoding
+        , Upgrade
+        , Vary
+        , KnownHeaderCount
+    };
+
+    QHttpHeaders();
+
+    static KnownHeader knownHeader(const char *name, int length);
+    static bool equalsIgnoreCase(const char *a, int aLength, const char *b, int bLength);
+
+    bool isEmpty() const { return entries.isEmpty(); }
+    int size() const { return entries.size(); }
+
+    // the data stays valid until the headers are changed
+    const char *nameData(int i) const { return storage.constData() + entries.at(i).name; }
+    int nameLength(int i) const { return entries.at(i).nameLength; }
+    const char *valueData(int i) const { return storage.constData() + entries.at(i).value; }
+    int valueLength(int i) const { return entries.at(i).valueLength; }
+    KnownHeader knownHeaderAt(int i) const { return entries.at(i).known; }
+    QByteArray nameAt(int i) const { return QByteArray(nameData(i), nameLength(i)); }
+    QByteArray valueAt(int i) const { return QByteArray(valueData(i), valueLength(i)); }
+
+    // the first entry of a header, nextIndex() finds the following ones
+    int indexOf(KnownHeader header) const { return indexes[header]; }
+    int indexOf(const QByteArray &name) const;
+    int nextIndex(int index) const;
+
+    bool contains(KnownHeader header) const { return indexes[header] >= 0; }
+    bool contains(const QByteArray &name) const { return indexOf(name) >= 0; }
+    // all values of a header joined by commas, or by semicolons for Cookie
+    QByteArray value(KnownHeader header) const;
+    QByteArray value(const QByteArray &name) const;
+    QList<QByteArray> values(const QByteArray &name) const;
+
+    // replaces all values of a header with the same name
+    void insert(const QByteArray &name, const QByteArray &value);
+    void insert(KnownHeader header, const QByteArray &value);
+    // adds one more value
+    void append(const QByteArray &name, const QByteArray &value);
+    void remove(KnownHeader header);
+    void remove(const QByteArray &name);
+    void clear();
+
+    // takes data as the storage, spans are added as offsets into it
+    void setStorage(const QByteArray &data);
+    void appendSpan(int name, int nameLength, int value, int valueLength);
+
+    QList<QByteArray> names() const;
+    void swap(QHttpHeaders &other);
+
+private:
+    struct Entry {
+        int name;
+        int nameLength;
+        int value;
+        int valueLength;
+        KnownHeader known;
+    };
+
+    struct KnownName {
+        const char *name;
+        int length;
+    };
+    static const KnownName knownNames[KnownHeaderCount];
+
+    QByteArray joined(int index) const;
+    void append(const char *name, int nameLength, const QByteArray &value, KnownHeader known);
+    void removeAll(int index);
+    void updateIndexes();
+
+    QByteArray storage;
+    QVarLengthArray<Entry, 16> entries;
+    int indexes[KnownHeaderCount];
+};
+
+#endif // QHTTPHEADERS_H
@@ -25,134 +25,606 @@
  */
 
 #include "qhttpreply.h"
+#include "qhttpcompressor_p.h"
 #include "qhttpconnection_p.h"
+#include "qhttpheaders_p.h"
 #include "qhttprequest.h"
+#include "qhttpserversettings_p.h"
 #include "qhttpserver_logging.h"
 
+#include <QtCore/QFile>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QSocketNotifier>
 #include <QtNetwork/QNetworkCookie>
 
-#include <zlib.h>
+#include <string.h>
+
+#if defined(Q_OS_LINUX)
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <time.h>
+#endif
 
 class QHttpReply::Private : public QObject
 {
     Q_OBJECT
 public:
     Private(QHttpConnection *c, QHttpReply *parent);
+    ~Private();
 
 public slots:
-    void writeHeaders();
     void writeBody();
+    void sendFileData();
+    void finished();
+
+private slots:
+    void socketWritable();
 
 private:
     QHttpReply *q;
-    static QHash<int, QByteArray> statusCodes;
-    QByteArray zlibEncodeData(const QByteArray &source, const QList<QByteArray> &acceptencodings) const;
+    QByteArray startCompression(const QHttpRequest *request);
+    void finishEncoding();
 
 public:
+    void recycle();
+    void finish();
+    void startFile();
+    QByteArray renderHead();
+    qint64 writeChunk(const char *data, qint64 len);
+    void sendChunk(const char *data, qint64 len);
+    void finishChunks();
+    void finishFile();
+
     QHttpConnection *connection;
     int status;
-    QHash<QByteArray, QByteArray> rawHeaders;
+    QHttpHeaders rawHeaders;
     QList<QNetworkCookie> cookies;
     QByteArray data;
+    bool streaming;
+    bool headersWritten;
+    bool chunked;
+    // finish() ran, the reply is queued for done() and must not end a second time
+    bool completed;
+    // the request is HEAD, everything but the body is sent
+    bool headOnly;
+    QFile *file;
+    qint64 fileOffset;
+    qint64 fileRemaining;
+    bool useSendfile;
+    QSocketNotifier *writeNotifier;
+    int compressionLevel;
+    QHttpReply::CompressionStrategy compressionStrategy;
+    QHttpContentEncoder *encoder;
+};
+
+// pre-rendered status lines for each status class, indexed by the last two digits
+struct QHttpStatusLine
+{
+    const char *data;
+    int length;
+};
+
+#define QHS_STATUS_LINE(code, reason) { "HTTP/1.1 " #code " " reason "\r\n", int(sizeof("HTTP/1.1 " #code " " reason "\r\n")) - 1 }
+#define QHS_NO_STATUS_LINE { 0, 0 }
+
+static const QHttpStatusLine informationalStatusLines[] = {
+    QHS_STATUS_LINE(100, "Continue"),
+    QHS_STATUS_LINE(101, "Switching Protocols"),
+};
+
+static const QHttpStatusLine successfulStatusLines[] = {
+    QHS_STATUS_LINE(200, "OK"),
+    QHS_STATUS_LINE(201, "Created"),
+    QHS_STATUS_LINE(202, "Accepted"),
+    QHS_STATUS_LINE(203, "Non-Authoritative Information"),
+    QHS_STATUS_LINE(204, "No Content"),
+    QHS_STATUS_LINE(205, "Reset Content"),
+    QHS_STATUS_LINE(206, "Partial Content"),
+};
+
+static const QHttpStatusLine redirectionStatusLines[] = {
+    QHS_STATUS_LINE(300, "Multiple Choices"),
+    QHS_STATUS_LINE(301, "Moved Permanently"),
+    QHS_STATUS_LINE(302, "Found"),
+    QHS_STATUS_LINE(303, "See Other"),
+    QHS_STATUS_LINE(304, "Not Modified"),
+    QHS_STATUS_LINE(305, "Use Proxy"),
+    QHS_NO_STATUS_LINE,
+    QHS_STATUS_LINE(307, "Temporary Redirect"),
+    QHS_STATUS_LINE(308, "Permanent Redirect"),
+};
+
+static const QHttpStatusLine clientErrorStatusLines[] = {
+    QHS_STATUS_LINE(400, "Bad Request"),
+    QHS_STATUS_LINE(401, "Unauthorized"),
+    QHS_STATUS_LINE(402, "Payment Required"),
+    QHS_STATUS_LINE(403, "Forbidden"),
+    QHS_STATUS_LINE(404, "Not Found"),
+    QHS_STATUS_LINE(405, "Method Not Allowed"),
+    QHS_STATUS_LINE(406, "Not Acceptable"),
+    QHS_STATUS_LINE(407, "Proxy Authentication Required"),
+    QHS_STATUS_LINE(408, "Request Time-out"),
+    QHS_STATUS_LINE(409, "Conflict"),
+    QHS_STATUS_LINE(410, "Gone"),
+    QHS_STATUS_LINE(411, "Length Required"),
+    QHS_STATUS_LINE(412, "Precondition Failed"),
+    QHS_STATUS_LINE(413, "Request Entity Too Large"),
+    QHS_STATUS_LINE(414, "Request-URI Too Large"),
+    QHS_STATUS_LINE(415, "Unsupported Media Type"),
+    QHS_STATUS_LINE(416, "Requested range not satisfiable"),
+    QHS_STATUS_LINE(417, "Expectation Failed"),
+    QHS_NO_STATUS_LINE,
+    QHS_NO_STATUS_LINE,
+    QHS_NO_STATUS_LINE,
+    QHS_NO_STATUS_LINE,
+    QHS_STATUS_LINE(422, "Unprocessable Entity"),
+    QHS_NO_STATUS_LINE,
+    QHS_NO_STATUS_LINE,
+    QHS_NO_STATUS_LINE,
+    QHS_STATUS_LINE(426, "Upgrade Required"),
+    QHS_NO_STATUS_LINE,
+    QHS_STATUS_LINE(428, "Precondition Required"),
+    QHS_STATUS_LINE(429, "Too Many Requests"),
+    QHS_NO_STATUS_LINE,
+    QHS_STATUS_LINE(431, "Request Header Fields Too Large"),
 };
 
-QHash<int, QByteArray> QHttpReply::Private::statusCodes;
+static const QHttpStatusLine serverErrorStatusLines[] = {
+    QHS_STATUS_LINE(500, "Internal Server Error"),
+    QHS_STATUS_LINE(501, "Not Implemented"),
+    QHS_STATUS_LINE(502, "Bad Gateway"),
+    QHS_STATUS_LINE(503, "Service Unavailable"),
+    QHS_STATUS_LINE(504, "Gateway Time-out"),
+    QHS_STATUS_LINE(505, "HTTP Version not supported"),
+};
+
+static const struct {
+    const QHttpStatusLine *lines;
+    int count;
+} statusClasses[] = {
+    { informationalStatusLines, int(sizeof(informationalStatusLines) / sizeof(QHttpStatusLine)) },
+    { successfulStatusLines, int(sizeof(successfulStatusLines) / sizeof(QHttpStatusLine)) },
+    { redirectionStatusLines, int(sizeof(redirectionStatusLines) / sizeof(QHttpStatusLine)) },
+    { clientErrorStatusLines, int(sizeof(clientErrorStatusLines) / sizeof(QHttpStatusLine)) },
+    { serverErrorStatusLines, int(sizeof(serverErrorStatusLines) / sizeof(QHttpStatusLine)) },
+};
+
+#undef QHS_STATUS_LINE
+#undef QHS_NO_STATUS_LINE
+
+// the returned array refers to the static table, codes without a reason phrase are rendered
+static QByteArray statusLine(int status)
+{
+    if (status >= 100 && status < 600) {
+        int index = status % 100;
+        const QHttpStatusLine *lines = statusClasses[status / 100 - 1].lines;
+        if (index < statusClasses[status / 100 - 1].count && lines[index].data)
+            return QByteArray::fromRawData(lines[index].data, lines[index].length);
+    }
+    return "HTTP/1.1 " + QByteArray::number(status) + " \r\n";
+}
 
 QHttpReply::Private::Private(QHttpConnection *c, QHttpReply *parent)
     : QObject(parent)
     , q(parent)
     , connection(c)
     , status(200)
+    , streaming(false)
+    , headersWritten(false)
+    , chunked(false)
+    , completed(false)
+    , headOnly(false)
+    , file(0)
+    , fileOffset(0)
+    , fileRemaining(0)
+    , useSendfile(false)
+    , writeNotifier(0)
+    , compressionLevel(-1)
+    , compressionStrategy(QHttpReply::DefaultStrategy)
+    , encoder(0)
 {
-    if (statusCodes.isEmpty()) {
-        statusCodes.insert(100, "Continue");
-        statusCodes.insert(101, "Switching Protocols");
-        statusCodes.insert(200, "OK");
-        statusCodes.insert(201, "Created");
-        statusCodes.insert(202, "Accepted");
-        statusCodes.insert(203, "Non-Authoritative Information");
-        statusCodes.insert(204, "No Content");
-        statusCodes.insert(205, "Reset Content");
-        statusCodes.insert(206, "Partial Content");
-        statusCodes.insert(300, "Multiple Choices");
-        statusCodes.insert(301, "Moved Permanently");
-        statusCodes.insert(302, "Found");
-        statusCodes.insert(303, "See Other");
-        statusCodes.insert(304, "Not Modified");
-        statusCodes.insert(305, "Use Proxy");
-        statusCodes.insert(307, "Temporary Redirect");
-        statusCodes.insert(400, "Bad Request");
-        statusCodes.insert(401, "Unauthorized");
-        statusCodes.insert(402, "Payment Required");
-        statusCodes.insert(403, "Forbidden");
-        statusCodes.insert(404, "Not Found");
-        statusCodes.insert(405, "Method Not Allowed");
-        statusCodes.insert(406, "Not Acceptable");
-        statusCodes.insert(407, "Proxy Authentication Required");
-        statusCodes.insert(408, "Request Time-out");
-        statusCodes.insert(409, "Conflict");
-        statusCodes.insert(410, "Gone");
-        statusCodes.insert(411, "Length Required");
-        statusCodes.insert(412, "Precondition Failed");
-        statusCodes.insert(413, "Request Entity Too Large");
-        statusCodes.insert(414, "Request-URI Too Large");
-        statusCodes.insert(415, "Unsupported Media Type");
-        statusCodes.insert(416, "Requested range not satisfiable");
-        statusCodes.insert(417, "Expectation Failed");
-        statusCodes.insert(500, "Internal Server Error");
-        statusCodes.insert(501, "Not Implemented");
-        statusCodes.insert(502, "Bad Gateway");
-        statusCodes.insert(503, "Service Unavailable");
-        statusCodes.insert(504, "Gateway Time-out");
-        statusCodes.insert(505, "HTTP Version not supported");
-    }
     q->setBuffer(&data);
     q->open(QIODevice::WriteOnly);
 }
 
-void QHttpReply::Private::writeHeaders()
+QHttpReply::Private::~Private()
+{
+    finishEncoding();
+}
+
+void QHttpReply::Private::recycle()
+{
+    finishEncoding();
+    status = 200;
+    rawHeaders.clear();
+    cookies.clear();
+    data.clear();
+    streaming = false;
+    headersWritten = false;
+    chunked = false;
+    completed = false;
+    headOnly = false;
+    delete file;
+    file = 0;
+    fileOffset = 0;
+    fileRemaining = 0;
+    useSendfile = false;
+    delete writeNotifier;
+    writeNotifier = 0;
+    compressionLevel = -1;
+    compressionStrategy = QHttpReply::DefaultStrategy;
+}
+
+// the reply may still be used until control returns to the event loop
+void QHttpReply::Private::finish()
 {
-    connection->write("HTTP/1.1 ");
-    connection->write(QByteArray::number(status));
-    connection->write(" ");
-    connection->write(statusCodes.value(status));
-    connection->write("\r\n");
+    if (completed)
+        return;
+    completed = true;
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+}
+
+void QHttpReply::Private::finished()
+{
+    emit q->done();
+    connection->replyFinished(q);
+}
+
+// CR and LF would end the header early, values are only copied when they contain one
+static void appendEscaped(QByteArray *head, const char *value, int length)
+{
+    if (!memchr(value, '\r', length) && !memchr(value, '\n', length)) {
+        head->append(value, length);
+        return;
+    }
+    QByteArray escaped(value, length);
+    head->append(escaped.replace('\r', "%0D").replace('\n', "%0A"));
+}
+
+// renders the status line and the headers, the body may be compressed on the way
+QByteArray QHttpReply::Private::renderHead()
+{
+    headersWritten = true;
     const QHttpRequest *request = connection->requestFor(q);
-    if (request && request->hasRawHeader("Accept-Encoding") && !rawHeaders.contains("Content-Encoding")) {
-        QList<QByteArray> acceptEncodings;
-        foreach (const QByteArray &acceptEncoding, request->rawHeader("Accept-Encoding").split(',')) {
-            acceptEncodings.append(acceptEncoding.trimmed());
+    headOnly = request && request->method() == "HEAD";
+    if (streaming) {
+        if (!rawHeaders.contains(QHttpHeaders::ContentLength)) {
+            // HTTP/1.0 clients read until the connection is closed
+            if (request && request->httpVersion() == "HTTP/1.1") {
+                chunked = true;
+                rawHeaders.insert(QHttpHeaders::TransferEncoding, "chunked");
+            } else {
+                rawHeaders.insert(QHttpHeaders::Connection, "Close");
+            }
         }
-        if (!acceptEncodings.isEmpty()) {
-            data = zlibEncodeData(data, acceptEncodings);
+    }
+    QByteArray encoding = file ? QByteArray() : startCompression(request);
+    if (!encoding.isEmpty()) {
+        rawHeaders.insert(QHttpHeaders::ContentEncoding, encoding);
+        if (!streaming) {
+            QHttpCompressionCache &cache = connection->settings()->compressionCache;
+            QByteArray key;
+            if (cache.maxSize() > 0)
+                key = QHttpCompressionCache::key(data, encoding, compressionLevel, compressionStrategy);
+            QByteArray encoded;
+            bool ok = !key.isEmpty() && cache.find(key, &encoded);
+            if (!ok) {
+                ok = encoder->encode(data.constData(), data.length(), QHttpContentEncoder::Finish, &encoded);
+                if (ok && !key.isEmpty())
+                    cache.insert(key, encoded);
+            }
+            if (ok) {
+                data = encoded;
+                rawHeaders.remove(QHttpHeaders::ContentLength);
+            } else {
+                rawHeaders.remove(QHttpHeaders::ContentEncoding);
+            }
+            finishEncoding();
         }
     }
 
-    if (!rawHeaders.contains("Content-Length")) {
-        rawHeaders.insert("Content-Length", QString::number(data.length()).toUtf8());
-    }
-    foreach (const QByteArray &rawHeader, rawHeaders.keys()) {
-        connection->write(rawHeader);
-        connection->write(": ");
-        QByteArray value = rawHeaders.value(rawHeader);
-        connection->write(value.replace('\r', "%0D").replace('\n', "%0A"));
-        connection->write("\r\n");
+    if (!streaming && !rawHeaders.contains(QHttpHeaders::ContentLength)) {
+        rawHeaders.insert(QHttpHeaders::ContentLength, QByteArray::number(data.length()));
     }
 
+    // the whole head is rendered into one buffer
+    QByteArray line = statusLine(status);
+    int size = line.length() + 2;
+    for (int i = 0; i < rawHeaders.size(); i++)
+        size += rawHeaders.nameLength(i) + rawHeaders.valueLength(i) + 4;
+    QList<QByteArray> setCookies;
     foreach (const QNetworkCookie &cookie, cookies) {
-        connection->write("Set-Cookie: ");
-        QByteArray value = cookie.toRawForm();
-        connection->write(value.replace('\r', "%0D").replace('\n', "%0A"));
-        connection->write(";\r\n");
+        setCookies.append(cookie.toRawForm());
+        size += setCookies.last().length() + 15;
+    }
+
+    QByteArray head;
+    head.reserve(size);
+    head.append(line);
+    for (int i = 0; i < rawHeaders.size(); i++) {
+        head.append(rawHeaders.nameData(i), rawHeaders.nameLength(i));
+        head.append(": ");
+        appendEscaped(&head, rawHeaders.valueData(i), rawHeaders.valueLength(i));
+        head.append("\r\n");
+    }
+    foreach (const QByteArray &cookie, setCookies) {
+        head.append("Set-Cookie: ");
+        appendEscaped(&head, cookie.constData(), cookie.length());
+        head.append(";\r\n");
+    }
+    head.append("\r\n");
+    return head;
+}
+
+// returns the index of the encoder the client prefers, or -1 when none of them
+// is acceptable. codings with q=0 are refused and ties go to the earlier encoder
+static int negotiateEncoding(const QByteArray &acceptEncoding, const QList<QPair<QByteArray, QHttpServer::ContentEncoderFactory> > &encoders)
+{
+    QVarLengthArray<double, 8> quality(encoders.length());
+    for (int i = 0; i < quality.size(); i++)
+        quality[i] = -1;
+    double wildcard = -1;
+    foreach (const QByteArray &item, acceptEncoding.split(',')) {
+        QList<QByteArray> params = item.split(';');
+        QByteArray coding = params.takeFirst().trimmed().toLower();
+        double q = 1;
+        foreach (const QByteArray &param, params) {
+            QByteArray value = param.trimmed();
+            if (value.length() > 2 && (value.at(0) == 'q' || value.at(0) == 'Q') && value.at(1) == '=') {
+                bool ok;
+                q = value.mid(2).toDouble(&ok);
+                if (!ok)
+                    q = 0;
+            }
+        }
+        if (coding == "*") {
+            wildcard = q;
+            continue;
+        }
+        if (coding == "x-gzip")
+            coding = "gzip";
+        for (int i = 0; i < encoders.length(); i++) {
+            if (encoders.at(i).first == coding) {
+                quality[i] = q;
+                break;
+            }
+        }
     }
 
-    connection->write("\r\n");
+    int best = -1;
+    double bestQuality = 0;
+    for (int i = 0; i < quality.size(); i++) {
+        double q = quality[i] < 0 ? wildcard : quality[i];
+        if (q > bestQuality) {
+            best = i;
+            bestQuality = q;
+        }
+    }
+    return best;
+}
+
+// applies the server's compression policy and prepares the encoder, the name of the
+// encoding is returned when the body is going to be compressed
+QByteArray QHttpReply::Private::startCompression(const QHttpRequest *request)
+{
+    if (compressionLevel == 0 || !request || rawHeaders.contains(QHttpHeaders::ContentEncoding))
+        return QByteArray();
+    // a streamed body with a fixed length is sent as it is
+    if (streaming && rawHeaders.contains(QHttpHeaders::ContentLength))
+        return QByteArray();
+    const QHttpServerSettings *settings = connection->settings();
+    if (!settings->isCompressible(rawHeaders.value(QHttpHeaders::ContentType), streaming ? -1 : data.length()))
+        return QByteArray();
+
+    // the body depends on Accept-Encoding from here on, even when this client gets it as it is
+    QByteArray vary = rawHeaders.value(QHttpHeaders::Vary);
+    if (vary.isEmpty())
+        rawHeaders.insert(QHttpHeaders::Vary, "Accept-Encoding");
+    else if (vary.trimmed() != "*" && !vary.toLower().contains("accept-encoding"))
+        rawHeaders.insert(QHttpHeaders::Vary, vary + ", Accept-Encoding");
+
+    int index = negotiateEncoding(request->rawHeader("Accept-Encoding"), settings->contentEncoders);
+    if (index < 0)
+        return QByteArray();
+    encoder = settings->contentEncoders.at(index).second();
+    if (!encoder)
+        return QByteArray();
+    if (!encoder->begin(compressionLevel, compressionStrategy)) {
+        finishEncoding();
+        return QByteArray();
+    }
+    return settings->contentEncoders.at(index).first;
+}
+
+void QHttpReply::Private::finishEncoding()
+{
+    if (!encoder)
+        return;
+    encoder->end();
+    delete encoder;
+    encoder = 0;
 }
 
 void QHttpReply::Private::writeBody()
 {
-    connection->write(data);
-    q->deleteLater();
+    if (completed)
+        return;
+    QByteArray head = renderHead();
+    connection->writeReply(q, head, data.constData(), headOnly ? 0 : data.length());
+    connection->endReply(q, false);
+    finish();
+}
+
+qint64 QHttpReply::Private::writeChunk(const char *data, qint64 len)
+{
+    if (!headersWritten) {
+        QByteArray head = renderHead();
+        connection->writeReply(q, head.constData(), head.length());
+        connect(connection, SIGNAL(bytesWritten(qint64)), q, SIGNAL(bytesWritten(qint64)));
+    }
+    if (len <= 0)
+        return 0;
+    if (encoder) {
+        // flushed on every write so that the client sees the data as soon as it is streamed
+        QByteArray encoded;
+        if (!encoder->encode(data, len, QHttpContentEncoder::SyncFlush, &encoded))
+            return -1;
+        sendChunk(encoded.constData(), encoded.length());
+    } else {
+        sendChunk(data, len);
+    }
+    return len;
+}
+
+void QHttpReply::Private::sendChunk(const char *data, qint64 len)
+{
+    if (len <= 0 || headOnly)
+        return;
+    if (chunked) {
+        QByteArray size = QByteArray::number(len, 16) + "\r\n";
+        connection->writeReply(q, size.constData(), size.length());
+    }
+    connection->writeReply(q, data, len);
+    if (chunked)
+        connection->writeReply(q, "\r\n", 2);
+}
+
+#if defined(Q_OS_LINUX)
+// sendfile(2) has no MSG_NOSIGNAL, so SIGPIPE is blocked on this thread while it runs
+// and a SIGPIPE raised by a closed connection is taken off the pending set
+static ssize_t sendfileNoSignal(int out, int in, off_t *offset, size_t count)
+{
+    sigset_t pipeSet;
+    sigset_t oldSet;
+    sigemptyset(&pipeSet);
+    sigaddset(&pipeSet, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+    ssize_t ret = ::sendfile(out, in, offset, count);
+    int error = errno;
+    if (ret < 0 && error == EPIPE && !sigismember(&oldSet, SIGPIPE)) {
+        struct timespec zero = { 0, 0 };
+        sigtimedwait(&pipeSet, 0, &zero);
+    }
+    pthread_sigmask(SIG_SETMASK, &oldSet, 0);
+    errno = error;
+    return ret;
+}
+#endif
+
+// runs whenever the connection has room for more of the file
+void QHttpReply::Private::sendFileData()
+{
+    // the headers in the socket's buffer have to go out before the file
+    if (!file->isOpen() || connection->bytesToWrite() > 0)
+        return;
+    if (fileRemaining == 0) {
+        finishFile();
+        return;
+    }
+
+#if defined(Q_OS_LINUX)
+    while (useSendfile && fileRemaining > 0) {
+        off_t offset = fileOffset;
+        ssize_t sent = sendfileNoSignal(connection->socketDescriptor(), file->handle(), &offset, qMin<qint64>(fileRemaining, 0x7ffff000));
+        if (sent > 0) {
+            fileOffset += sent;
+            fileRemaining -= sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            connection->setWriteBlocked(true);
+            if (!writeNotifier) {
+                writeNotifier = new QSocketNotifier(connection->socketDescriptor(), QSocketNotifier::Write, this);
+                connect(writeNotifier, SIGNAL(activated(int)), this, SLOT(socketWritable()));
+            }
+            writeNotifier->setEnabled(true);
+            return;
+        } else if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            useSendfile = false;
+        } else {
+            qhsWarning() << "sending" << file->fileName() << "failed:" << (sent < 0 ? strerror(errno) : "unexpected end of file");
+            connection->abort();
+            finishFile();
+            return;
+        }
+    }
+    if (fileRemaining == 0) {
+        finishFile();
+        return;
+    }
+#endif
+
+    // one mapped piece at a time, the next one is queued when the socket has drained this one
+    qint64 length = qMin<qint64>(fileRemaining, 1024 * 1024);
+    uchar *map = file->map(fileOffset, length);
+    if (map) {
+        connection->write(reinterpret_cast<const char *>(map), length);
+        file->unmap(map);
+    } else {
+        QByteArray piece;
+        if (file->seek(fileOffset))
+            piece = file->read(length);
+        if (piece.length() != length) {
+            qhsWarning() << "reading" << file->fileName() << "failed:" << file->errorString();
+            connection->abort();
+            finishFile();
+            return;
+        }
+        connection->write(piece);
+    }
+    fileOffset += length;
+    fileRemaining -= length;
+}
+
+void QHttpReply::Private::startFile()
+{
+    connection->write(renderHead());
+    if (headOnly) {
+        finishFile();
+        return;
+    }
+    connect(connection, SIGNAL(bytesWritten(qint64)), this, SLOT(sendFileData()));
+    connection->flush();
+    sendFileData();
+}
+
+void QHttpReply::Private::socketWritable()
+{
+    writeNotifier->setEnabled(false);
+    connection->setWriteBlocked(false);
+    sendFileData();
+}
+
+void QHttpReply::Private::finishFile()
+{
+    if (completed)
+        return;
+    disconnect(connection, SIGNAL(bytesWritten(qint64)), this, SLOT(sendFileData()));
+    delete writeNotifier;
+    writeNotifier = 0;
+    file->close();
+    connection->endReply(q, false);
+    finish();
+}
+
+void QHttpReply::Private::finishChunks()
+{
+    if (completed)
+        return;
+    disconnect(connection, SIGNAL(bytesWritten(qint64)), q, SIGNAL(bytesWritten(qint64)));
+    if (encoder) {
+        QByteArray encoded;
+        encoder->encode(0, 0, QHttpContentEncoder::Finish, &encoded);
+        finishEncoding();
+        sendChunk(encoded.constData(), encoded.length());
+    }
+    if (chunked && !headOnly)
+        connection->writeReply(q, "0\r\n\r\n", 5);
+    // without a length the end of the body is the end of the connection
+    connection->endReply(q, !chunked && !rawHeaders.contains(QHttpHeaders::ContentLength));
+    finish();
 }
 
 QHttpReply::QHttpReply(QHttpConnection *parent)
@@ -163,9 +635,32 @@ QHttpReply::QHttpReply(QHttpConnection *parent)
 
 QHttpReply::~QHttpReply()
 {
+    if (d->connection)
+        d->connection->replyDestroyed(this);
     delete d;
 }
 
+void QHttpReply::recycle()
+{
+    disconnect(this, 0, 0, 0);
+    disconnect(d->connection, 0, this, 0);
+    disconnect(d->connection, 0, d, 0);
+    const QObjectList objects = children();
+    foreach (QObject *object, objects) {
+        if (object != d)
+            delete object;
+    }
+    QBuffer::close();
+    d->recycle();
+    open(QIODevice::WriteOnly);
+}
+
+void QHttpReply::startSending()
+{
+    if (d->file && !d->headersWritten)
+        d->startFile();
+}
+
 int QHttpReply::status() const
 {
     return d->status;
@@ -200,7 +695,7 @@ void QHttpReply::setRawHeader(const QByteArray &headerName, const QByteArray &va
 
 QList<QByteArray> QHttpReply::rawHeaderList() const
 {
-    return d->rawHeaders.keys();
+    return d->rawHeaders.names();
 }
 
 const QList<QNetworkCookie> &QHttpReply::cookies() const
@@ -214,62 +709,118 @@ void QHttpReply::setCookies(const QList<QNetworkCookie> &cookies)
     d->cookies = cookies;
 }
 
-void QHttpReply::close()
+int QHttpReply::compressionLevel() const
 {
-    QBuffer::close();
-//    QMetaObject::invokeMethod(d, "close", Qt::QueuedConnection);
-    d->writeHeaders();
-    d->writeBody();
+    return d->compressionLevel;
+}
+
+void QHttpReply::setCompressionLevel(int compressionLevel)
+{
+    if (d->compressionLevel == compressionLevel) return;
+    if (compressionLevel < -1 || compressionLevel > 9) {
+        qhsWarning() << "invalid compression level" << compressionLevel;
+        return;
+    }
+    d->compressionLevel = compressionLevel;
+    emit compressionLevelChanged(compressionLevel);
 }
 
-QByteArray QHttpReply::Private::zlibEncodeData(const QByteArray &source, const QList<QByteArray> &acceptencodings) const
+QHttpReply::CompressionStrategy QHttpReply::compressionStrategy() const
 {
-    z_stream z;
-    z.zalloc = NULL;
-    z.zfree = NULL;
-    z.opaque = NULL;
+    return d->compressionStrategy;
+}
 
-    int status = Z_STREAM_ERROR;
-    QByteArray encoding;
-    QByteArray ret = source;
+void QHttpReply::setCompressionStrategy(CompressionStrategy compressionStrategy)
+{
+    if (d->compressionStrategy == compressionStrategy) return;
+    d->compressionStrategy = compressionStrategy;
+    emit compressionStrategyChanged(compressionStrategy);
+}
 
-    if (acceptencodings.contains("gzip")) {
-        encoding = "gzip";
-        status = deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
-    } else if (acceptencodings.contains("deflate")) {
-        encoding = "deflate";
-        status = deflateInit(&z, Z_DEFAULT_COMPRESSION);
+bool QHttpReply::isStreaming() const
+{
+    return d->streaming;
+}
+
+void QHttpReply::setStreaming(bool streaming)
+{
+    if (d->streaming == streaming) return;
+    if (d->headersWritten) {
+        qhsWarning() << "streaming can not be changed after the headers are sent.";
+        return;
     }
+    d->streaming = streaming;
+    emit streamingChanged(streaming);
+}
 
-    if (status == Z_OK) {
-        QByteArray sourceData = source;
-        unsigned char buf[1024];
-
-        ret.clear();
-        z.avail_in = sourceData.size();
-        z.next_in = reinterpret_cast<Bytef*>(sourceData.data());
-        z.avail_out = 1024;
-        z.next_out = buf;
-
-        while (status == Z_OK) {
-            status = deflate(&z, Z_FINISH);
-            if (status == Z_STREAM_END) {
-                ret.append((const char*)buf, 1024 - z.avail_out);
-                q->setRawHeader("Content-Encoding", encoding);
-                q->setRawHeader("Content-Length", QString::number(ret.length()).toUtf8());
-                break;
-            } else if (status != Z_OK) {
-                qhsWarning() << "data encoding [" << QString::fromUtf8(encoding) << "] failed:" << status << z.msg;
-            }
-            if (z.avail_out == 0) {
-                ret.append((const char*)buf, 1024);
-                z.avail_out = 1024;
-                z.next_out = buf;
-            }
-        }
-        deflateEnd(&z);
+qint64 QHttpReply::bytesToWrite() const
+{
+    if (d->headersWritten)
+        return d->connection->bytesToWrite();
+    return QBuffer::bytesToWrite();
+}
+
+qint64 QHttpReply::writeData(const char *data, qint64 len)
+{
+    if (d->streaming)
+        return d->writeChunk(data, len);
+    return QBuffer::writeData(data, len);
+}
+
+bool QHttpReply::sendFile(const QString &fileName, qint64 offset, qint64 length)
+{
+    if (d->headersWritten || d->file) {
+        qhsWarning() << "the reply has been sent already.";
+        return false;
     }
-    return ret;
+    QFile *file = new QFile(fileName, d);
+    if (!file->open(QIODevice::ReadOnly)) {
+        qhsWarning() << "failed to open" << fileName << file->errorString();
+        delete file;
+        return false;
+    }
+    qint64 size = file->size();
+    if (length < 0)
+        length = size - offset;
+    if (offset < 0 || length < 0 || offset + length > size) {
+        qhsWarning() << "invalid range" << offset << length << "for" << fileName;
+        delete file;
+        return false;
+    }
+
+    d->file = file;
+    d->fileOffset = offset;
+    d->fileRemaining = length;
+#if defined(Q_OS_LINUX)
+    d->useSendfile = true;
+#endif
+    QBuffer::close();
+    d->streaming = false;
+    d->data.clear();
+    d->rawHeaders.insert(QHttpHeaders::ContentLength, QByteArray::number(length));
+    // the file goes straight to the socket, so it waits for the replies ahead of it
+    if (d->connection->isSending(this))
+        d->startFile();
+    return true;
+}
+
+void QHttpReply::close()
+{
+    QBuffer::close();
+    // a second close() must not queue the reply again
+    if (d->completed)
+        return;
+    // the reply finishes itself once the file is sent
+    if (d->file)
+        return;
+//    QMetaObject::invokeMethod(d, "close", Qt::QueuedConnection);
+    if (d->headersWritten) {
+        d->finishChunks();
+        return;
+    }
+    // nothing has been streamed, the reply is sent as a whole
+    d->streaming = false;
+    d->writeBody();
 }
 
 #include "qhttpreply.moc"
@@ -36,11 +36,26 @@ class QNetworkCookie;
 
 QT_BEGIN_NAMESPACE
 
+// a reply belongs to the connection of its request. after done() the connection may reuse
+// the object for a later reply on the same connection, never on another one, so do not
+// keep the pointer or connections made to it beyond that point
 class Q_HTTPSERVER_EXPORT QHttpReply : public QBuffer
 {
     Q_OBJECT
     Q_PROPERTY(int status READ status WRITE setStatus NOTIFY statusChanged)
+    Q_PROPERTY(bool streaming READ isStreaming WRITE setStreaming NOTIFY streamingChanged)
+    Q_PROPERTY(int compressionLevel READ compressionLevel WRITE setCompressionLevel NOTIFY compressionLevelChanged)
+    Q_PROPERTY(CompressionStrategy compressionStrategy READ compressionStrategy WRITE setCompressionStrategy NOTIFY compressionStrategyChanged)
 public:
+    enum CompressionStrategy {
+        DefaultStrategy
+        , FilteredStrategy
+        , HuffmanOnlyStrategy
+        , RleStrategy
+        , FixedStrategy
+    };
+    Q_ENUM(CompressionStrategy)
+
     explicit QHttpReply(QHttpConnection *parent);
     ~QHttpReply();
 
@@ -55,13 +70,46 @@ public:
     const QList<QNetworkCookie> &cookies() const;
     void setCookies(const QList<QNetworkCookie> &cookies);
 
+    // in streaming mode the first write() sends the headers and every write() is sent
+    // to the client right away, chunked unless Content-Length is set.
+    // bytesToWrite() and bytesWritten() report what is still queued on the connection.
+    bool isStreaming() const;
+    void setStreaming(bool streaming);
+
+    // zlib level used when the client accepts gzip or deflate, -1 is zlib's default
+    // and 0 turns compression off for this reply. streamed replies are compressed too.
+    int compressionLevel() const;
+    void setCompressionLevel(int compressionLevel);
+    CompressionStrategy compressionStrategy() const;
+    void setCompressionStrategy(CompressionStrategy compressionStrategy);
+
+    qint64 bytesToWrite() const;
     virtual void close();
 
+    // sends length bytes of the file from offset, or the rest of it when length is -1, and
+    // finishes the reply. uses sendfile(2) on Linux and mapped file pieces elsewhere.
+    // returns false when the file can not be opened or the range is invalid.
+    bool sendFile(const QString &fileName, qint64 offset = 0, qint64 length = -1);
+
 Q_SIGNALS:
+    // emitted once the reply has been handed to the connection
     void done();
     void statusChanged(int status);
+    void streamingChanged(bool streaming);
+    void compressionLevelChanged(int compressionLevel);
+    void compressionStrategyChanged(CompressionStrategy compressionStrategy);
+
+protected:
+    qint64 writeData(const char *data, qint64 len);
 
 private:
+    // the connection reuses the reply once done() has been emitted,
+    // connections made to it are dropped at that point
+    friend class QHttpConnection;
+    void recycle();
+    // the replies ahead of this one have been sent
+    void startSending();
+
     class Private;
     Private *d;
     Q_DISABLE_COPY(QHttpReply)
@@ -27,33 +27,95 @@
 #include "qhttprequest.h"
 #include "qhttpserver_logging.h"
 #include "qhttpconnection_p.h"
+#include "qhttpheaders_p.h"
+#include "qhttpscan_p.h"
+
+#include "qhttpserversettings_p.h"
+
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QVarLengthArray>
+
+#include <ctype.h>
+#include <string.h>
 
 class QHttpFileData::Private
 {
 public:
+    Private(QHttpFileData *parent, const QHash<QByteArray, QByteArray> &rawHeaders);
+
+    void spool();
+
+    QHttpFileData *q;
     QString fileName;
     QString contentType;
     QByteArray data;
+    QBuffer *buffer;
+    QIODevice *device;
+    qint64 memoryThreshold;
 };
 
-QHttpFileData::QHttpFileData(const QHash<QByteArray, QByteArray> &rawHeaders, const QByteArray &data, QObject *parent)
-    : QBuffer(parent)
-    , d(new Private)
+QHttpFileData::Private::Private(QHttpFileData *parent, const QHash<QByteArray, QByteArray> &rawHeaders)
+    : q(parent)
+    , buffer(0)
+    , device(0)
+    , memoryThreshold(-1)
 {
     if (rawHeaders.contains("Content-Type")) {
-        d->contentType = QString::fromUtf8(rawHeaders.value("Content-Type"));
+        contentType = QString::fromUtf8(rawHeaders.value("Content-Type"));
     }
     if (rawHeaders.contains("Content-Disposition")) {
         QByteArray contentDisposition = rawHeaders.value("Content-Disposition");
         contentDisposition = contentDisposition.mid(contentDisposition.indexOf("filename=\"") + 10);
         contentDisposition.chop(1);
-        d->fileName = QString::fromUtf8(contentDisposition);
+        fileName = QString::fromUtf8(contentDisposition);
     }
+}
+
+// moves the content received so far from memory to a temporary file
+void QHttpFileData::Private::spool()
+{
+    QTemporaryFile *file = new QTemporaryFile(q);
+    if (!file->open()) {
+        qhsWarning() << "failed to create a temporary file for" << fileName << file->errorString();
+        delete file;
+        memoryThreshold = -1;
+        return;
+    }
+    file->write(data);
+    delete buffer;
+    buffer = 0;
+    data.clear();
+    device = file;
+}
+
+QHttpFileData::QHttpFileData(const QHash<QByteArray, QByteArray> &rawHeaders, const QByteArray &data, QObject *parent)
+    : QIODevice(parent)
+    , d(new Private(this, rawHeaders))
+{
     d->data = data;
-    setBuffer(&d->data);
+    d->buffer = new QBuffer(&d->data, this);
+    d->buffer->open(QIODevice::ReadOnly);
+    d->device = d->buffer;
     open(QIODevice::ReadOnly);
 }
 
+QHttpFileData::QHttpFileData(const QHash<QByteArray, QByteArray> &rawHeaders, QIODevice *device, qint64 memoryThreshold, QObject *parent)
+    : QIODevice(parent)
+    , d(new Private(this, rawHeaders))
+{
+    if (device) {
+        d->device = device;
+        if (!device->parent())
+            device->setParent(this);
+    } else {
+        d->memoryThreshold = memoryThreshold;
+        d->buffer = new QBuffer(&d->data, this);
+        d->buffer->open(QIODevice::ReadWrite);
+        d->device = d->buffer;
+    }
+    QIODevice::open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+}
+
 QHttpFileData::~QHttpFileData()
 {
     delete d;
@@ -69,211 +131,761 @@ const QString &QHttpFileData::contentType() const
     return d->contentType;
 }
 
+QIODevice *QHttpFileData::device() const
+{
+    return d->device;
+}
+
+bool QHttpFileData::open(OpenMode mode)
+{
+    if (!QIODevice::open(mode | QIODevice::Unbuffered))
+        return false;
+    if (!d->device->isSequential())
+        d->device->seek(0);
+    return true;
+}
+
+bool QHttpFileData::isSequential() const
+{
+    return d->device->isSequential();
+}
+
+qint64 QHttpFileData::size() const
+{
+    return d->device->size();
+}
+
+bool QHttpFileData::seek(qint64 pos)
+{
+    return QIODevice::seek(pos) && d->device->seek(pos);
+}
+
+qint64 QHttpFileData::readData(char *data, qint64 maxSize)
+{
+    return d->device->read(data, maxSize);
+}
+
+qint64 QHttpFileData::writeData(const char *data, qint64 maxSize)
+{
+    if (d->buffer && d->memoryThreshold >= 0 && d->data.size() + maxSize > d->memoryThreshold)
+        d->spool();
+    return d->device->write(data, maxSize);
+}
+
 
 class QHttpRequest::Private : public QObject
 {
     Q_OBJECT
 public:
     enum ReadState {
-        ReadUrl
+        ReadRequestLine
         , ReadHeaders
         , ReadBody
+        , ReadDone
+    };
+
+    enum MultipartState {
+        MultipartPreamble
+        , MultipartDelimiter
         , MultipartHeader
         , MultipartBody
-        , ReadDone
+        , MultipartEpilogue
+    };
+
+    enum ChunkState {
+        ChunkSize
+        , ChunkData
+        , ChunkDataEnd
+        , ChunkTrailer
+    };
+
+    // a header line as offsets into the connection buffer
+    struct HeaderSpan {
+        int name;
+        int nameLength;
+        int value;
+        int valueLength;
     };
 
     explicit Private(QHttpRequest *parent);
 
-private slots:
+    void buildUrl();
+    void recycle();
+
+public slots:
     void readyRead();
-    void disconnected();
 
 private:
+    bool parseRequestLine(const char *begin, const char *end);
+    void parseHeaderLine(const char *buffer, const char *begin, const char *end);
+    void headersDone(int headLength);
+    void readBody();
+    void readChunkedBody();
+    void bodyData(const char *begin, int length);
+    void bodyDone();
+    int parseMultipart(const char *begin, const char *end);
+    void beginPart();
+    void writePart(const char *data, int length);
+    void endPart();
+    void error(const char *message);
+    void refuse(const char *status);
+    void refuseBody(const char *status, const char *message);
+    bool isBodyTooLarge(qint64 length) const;
+    bool isLineTooLong(qint64 length) const;
+
     QHttpRequest *q;
+    int lineStart;
+    int searchFrom;
+    QVarLengthArray<HeaderSpan, 32> headerSpans;
 
 public:
     QUrl url;
+    bool urlBuilt;
     ReadState state;
     QByteArray method;
+    QByteArray target;
+    QByteArray httpVersion;
+    QByteArray host;
+    qint64 bodyLength;
+    qint64 bodyRead;
+    bool chunked;
+    ChunkState chunkState;
+    qint64 chunkRemaining;
+    bool streaming;
+    bool paused;
     QByteArray data;
     QByteArray multipartBoundary;
+    QByteArray multipartDelimiter;
+    MultipartState multipartState;
+    QByteArray multipartPending;
+    QHash<QByteArray, QByteArray> multipartRawHeaders;
+    QHttpFileData *multipartFile;
+    qint64 multipartFileSize;
+    QByteArray multipartField;
+    bool multipartSkip;
     QList<QHttpFileData *> files;
 };
 
 QHttpRequest::Private::Private(QHttpRequest *parent)
     : QObject(parent)
     , q(parent)
-    , state(ReadUrl)
+    , lineStart(0)
+    , searchFrom(0)
+    , urlBuilt(false)
+    , state(ReadRequestLine)
+    , bodyLength(0)
+    , bodyRead(0)
+    , chunked(false)
+    , chunkState(ChunkSize)
+    , chunkRemaining(0)
+    , streaming(false)
+    , paused(false)
+    , multipartState(MultipartPreamble)
+    , multipartFile(0)
+    , multipartFileSize(0)
+    , multipartSkip(false)
 {
-    connect(q->connection(), SIGNAL(readyRead()), this, SLOT(readyRead()));
-    connect(q->connection(), SIGNAL(disconnected()), this, SLOT(disconnected()));
     q->setBuffer(&data);
     q->open(QIODevice::ReadOnly);
 }
 
+void QHttpRequest::Private::recycle()
+{
+    if (paused)
+        q->connection()->setReadBufferSize(q->connection()->settings()->readBufferSize);
+    lineStart = 0;
+    searchFrom = 0;
+    headerSpans.clear();
+    url.clear();
+    urlBuilt = false;
+    state = ReadRequestLine;
+    method.clear();
+    target.clear();
+    httpVersion.clear();
+    host.clear();
+    bodyLength = 0;
+    bodyRead = 0;
+    chunked = false;
+    chunkState = ChunkSize;
+    chunkRemaining = 0;
+    streaming = false;
+    paused = false;
+    data.clear();
+    multipartBoundary.clear();
+    multipartDelimiter.clear();
+    multipartState = MultipartPreamble;
+    multipartPending.clear();
+    multipartRawHeaders.clear();
+    delete multipartFile;
+    multipartFile = 0;
+    multipartFileSize = 0;
+    multipartField.clear();
+    multipartSkip = false;
+    // files taken over by the application are left alone
+    foreach (QHttpFileData *file, files) {
+        if (file->parent() == this)
+            delete file;
+    }
+    files.clear();
+}
+
+void QHttpRequest::Private::buildUrl()
+{
+    urlBuilt = true;
+    int question = target.indexOf('?');
+    int pathLength = question < 0 ? target.length() : question;
+    url.setPath(QString::fromUtf8(target.constData(), pathLength), QUrl::StrictMode);
+    if (question > -1)
+        url.setQuery(QString::fromUtf8(target.constData() + question + 1, target.length() - question - 1));
+    url.setScheme(QLatin1String("http"));
+
+    if (!host.isEmpty()) {
+        int colon = host.lastIndexOf(':');
+        if (colon > host.lastIndexOf(']')) {
+            url.setHost(QString::fromUtf8(host.constData(), colon));
+            url.setPort(host.mid(colon + 1).toUInt());
+        } else {
+            url.setHost(QString::fromUtf8(host));
+            url.setPort(80);
+        }
+    }
+}
+
+void QHttpRequest::Private::error(const char *message)
+{
+    qhsWarning() << message;
+    state = ReadDone;
+    q->connection()->disconnectFromHost();
+}
+
+// answers a request over the limits without handing it out, the connection is closed after it
+void QHttpRequest::Private::refuse(const char *status)
+{
+    qhsDebug() << "request from" << q->remoteAddress() << "refused with" << status;
+    state = ReadDone;
+    q->connection()->refuseRequest(q, status);
+}
+
+// a streamed request has been handed out, its reply is up to the application
+void QHttpRequest::Private::refuseBody(const char *status, const char *message)
+{
+    if (streaming)
+        error(message);
+    else
+        refuse(status);
+}
+
+// length is the body size received so far or announced
+bool QHttpRequest::Private::isBodyTooLarge(qint64 length) const
+{
+    qint64 maxBodySize = q->connection()->settings()->maxBodySize;
+    return maxBodySize > 0 && length > maxBodySize;
+}
+
+// the lines inside a body, like chunk sizes, trailers and part headers, are buffered
+// until their end arrives and are held to the limit of the request line
+bool QHttpRequest::Private::isLineTooLong(qint64 length) const
+{
+    int maxRequestLineLength = q->connection()->settings()->maxRequestLineLength;
+    return maxRequestLineLength > 0 && length > maxRequestLineLength;
+}
+
+bool QHttpRequest::Private::parseRequestLine(const char *begin, const char *end)
+{
+    const char *space1 = qhsFindChar(begin, end, ' ');
+    if (space1 == end)
+        return false;
+    const char *space2 = qhsFindChar(space1 + 1, end, ' ');
+    if (space2 == end || space1 == begin || space2 == space1 + 1)
+        return false;
+    if (qhsFindChar(space2 + 1, end, ' ') != end)
+        return false;
+
+    int versionLength = end - space2 - 1;
+    if (versionLength == 8 && qstrncmp(space2 + 1, "HTTP/1.1", 8) == 0) {
+        httpVersion = QByteArrayLiteral("HTTP/1.1");
+    } else if (versionLength == 8 && qstrncmp(space2 + 1, "HTTP/1.0", 8) == 0) {
+        httpVersion = QByteArrayLiteral("HTTP/1.0");
+    } else {
+        qhsWarning() << QByteArray(space2 + 1, versionLength) << "is not supported.";
+        return false;
+    }
+
+    method = QByteArray(begin, space1 - begin);
+    target = QByteArray(space1 + 1, space2 - space1 - 1);
+    return true;
+}
+
+void QHttpRequest::Private::parseHeaderLine(const char *buffer, const char *begin, const char *end)
+{
+    const char *colon = qhsFindChar(begin, end, ':');
+    if (colon == end || colon == begin)
+        return;
+    const char *value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t'))
+        value++;
+    const char *valueEnd = end;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+        valueEnd--;
+
+    HeaderSpan span;
+    span.name = begin - buffer;
+    span.nameLength = colon - begin;
+    span.value = value - buffer;
+    span.valueLength = valueEnd - value;
+    headerSpans.append(span);
+}
+
 void QHttpRequest::Private::readyRead()
 {
+    // the socket's read buffer fills up while paused and the peer is throttled by TCP
+    if (paused || state == ReadDone)
+        return;
     QHttpConnection *connection = q->connection();
-    switch (state) {
-    case ReadUrl:
-        if (connection->canReadLine()) {
-            QByteArray line = connection->readLine();
-            line = line.left(line.length() - 2);
-            QList<QByteArray> array = line.split(' ');
-            if (array.length() != 3) {
-                qhsWarning() << "unknown request:" << array;
-                connection->disconnectFromHost();
+    connection->fillBuffer();
+
+    if (state == ReadRequestLine || state == ReadHeaders) {
+        const QHttpServerSettings *settings = connection->settings();
+        const QByteArray &buffer = connection->buffer();
+        const char *begin = buffer.constData();
+        const char *end = begin + buffer.size();
+
+        // the head is refused as soon as it is over a limit, it never has to be buffered whole
+        while (state == ReadRequestLine || state == ReadHeaders) {
+            const char *lf = qhsFindChar(begin + searchFrom, end, '\n');
+            const char *line = begin + lineStart;
+            if (state == ReadRequestLine && settings->maxRequestLineLength > 0 && (lf - line) > settings->maxRequestLineLength) {
+                refuse("414 URI Too Long");
+                return;
+            }
+            if (settings->maxHeaderSize > 0 && (lf - begin) > settings->maxHeaderSize) {
+                refuse("431 Request Header Fields Too Large");
                 return;
             }
-            method = array.takeFirst();
+            if (lf == end) {
+                // wait for the rest of the line
+                searchFrom = buffer.size();
+                return;
+            }
+            const char *lineEnd = lf;
+            if (lineEnd > line && lineEnd[-1] == '\r')
+                lineEnd--;
+            lineStart = searchFrom = lf + 1 - begin;
 
-            QString path = QString::fromUtf8(array.takeFirst());
-            url.setPath(path.section('?', 0, 0), QUrl::StrictMode);
-            url.setQuery(path.section('?', 1));
-            url.setScheme(QLatin1String("http"));
+            if (state == ReadRequestLine) {
+                // empty lines before the request line are ignored
+                if (lineEnd == line)
+                    continue;
+                if (!parseRequestLine(line, lineEnd)) {
+                    error("unknown request.");
+                    return;
+                }
+                state = ReadHeaders;
+            } else if (lineEnd == line) {
+                headersDone(lineStart);
+                if (state != ReadBody)
+                    return;
+            } else if (settings->maxHeaderCount > 0 && headerSpans.size() >= settings->maxHeaderCount) {
+                refuse("431 Request Header Fields Too Large");
+                return;
+            } else {
+                parseHeaderLine(begin, line, lineEnd);
+            }
+        }
+    }
+
+    if (state == ReadBody)
+        readBody();
+}
 
-            QByteArray http = array.takeFirst();
-            if (http != "HTTP/1.1" && http != "HTTP/1.0") {
-                qhsWarning() << http << "is not supported.";
-                connection->disconnectFromHost();
+void QHttpRequest::Private::headersDone(int headLength)
+{
+    QHttpConnection *connection = q->connection();
+    QByteArray upgrade;
+    bool hasContentLength = false;
+    bool expectContinue = false;
+
+    // the head is kept as it was received and the headers refer into it,
+    // on keep-alive connections the arena memory is reused by the next request
+    QHttpHeaders &headers = q->rawHeaders();
+    char *storage = q->allocate(headLength);
+    if (storage) {
+        memcpy(storage, connection->buffer().constData(), headLength);
+        headers.setStorage(QByteArray::fromRawData(storage, headLength));
+        connection->consume(headLength);
+    } else {
+        headers.setStorage(connection->takeBuffer(headLength));
+    }
+    for (int i = 0; i < headerSpans.size(); i++) {
+        const HeaderSpan &span = headerSpans.at(i);
+        headers.appendSpan(span.name, span.nameLength, span.value, span.valueLength);
+    }
+    headerSpans.clear();
+    lineStart = searchFrom = 0;
+
+    for (int i = 0; i < headers.size(); i++) {
+        switch (headers.knownHeaderAt(i)) {
+        case QHttpHeaders::Upgrade:
+            upgrade = headers.valueAt(i);
+            break;
+        case QHttpHeaders::Host:
+            host = headers.valueAt(i);
+            break;
+        case QHttpHeaders::Cookie:
+            foreach (const QByteArray &c, headers.valueAt(i).split(';')) {
+                q->addCookie(QNetworkCookie::parseCookies(c));
+            }
+            break;
+        case QHttpHeaders::ContentLength: {
+            bool ok = false;
+            qint64 length = headers.valueAt(i).toLongLong(&ok);
+            if (!ok || length < 0 || (hasContentLength && length != bodyLength)) {
+                error("invalid Content-Length.");
                 return;
             }
-            state = ReadHeaders;
+            bodyLength = length;
+            hasContentLength = true;
+            break;
         }
-//        break;
-    case ReadHeaders:
-        while (connection->canReadLine()) {
-            QByteArray line = connection->readLine();
-            line = line.left(line.length() - 2);
-            if (line.isEmpty()) {
-                if (!q->hasRawHeader("Content-Length")) {
-                    state = ReadDone;
-                    disconnect(connection, SIGNAL(readyRead()), this, SLOT(readyRead()));
-                    emit q->ready();
-                } else {
-                    state = ReadBody;
-                    QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
-                }
-                break;
+        case QHttpHeaders::TransferEncoding:
+            // chunked has to be the last coding and overrides Content-Length
+            chunked = headers.valueAt(i).toLower().trimmed().endsWith("chunked");
+            break;
+        case QHttpHeaders::Expect:
+            expectContinue = headers.valueAt(i).toLower() == "100-continue";
+            break;
+        case QHttpHeaders::ContentType: {
+            QList<QByteArray> fields = headers.valueAt(i).split(';');
+            QByteArray boundary(" boundary=");
+            if (fields.first().toLower() == "multipart/form-data" && fields.length() == 2 && fields.at(1).startsWith(boundary)) {
+                multipartBoundary = fields.at(1).mid(boundary.length());
+                multipartBoundary.prepend("--");
+                multipartDelimiter = "\r\n" + multipartBoundary;
             }
+            break;
+        }
+        default:
+            break;
+        }
+    }
 
-            int space = line.indexOf(' ');
-            if (space > 0) {
-                QByteArray name = line.left(space - 1);
-                QByteArray value = line.mid(space + 1);
-                if (name == "Upgrade") {
-                    disconnect(connection, 0, this, 0);
-                    emit q->upgrade(value, url, q->rawHeaders());
-                    return;
-                } else if (name == "Host") {
-                    int colon = value.indexOf(':');
-                    if (colon > -1) {
-                        url.setHost(QString::fromUtf8(value.left(colon)));
-                        url.setPort(value.mid(colon + 1).toUInt());
-                    } else {
-                        url.setHost(QString::fromUtf8(value));
-                        url.setPort(80);
-                    }
-                } else if (name == "Cookie") {
-                    foreach (const QByteArray &c, value.split(';')) {
-                        q->addCookie(QNetworkCookie::parseCookies(c));
-                    }
-                } else if (name == "Content-Type") {
-                    QList<QByteArray> fields = value.split(';');
-                    QByteArray boundary(" boundary=");
-                    if (fields.first().toLower() == "multipart/form-data" && fields.length() == 2 && fields.at(1).startsWith(boundary)) {
-                        q->insertRawHeader(name.toLower(), fields.takeFirst().toLower());
-                        multipartBoundary = fields.takeFirst().mid(boundary.length());
-                        multipartBoundary.prepend("--");
-                    } else {
-                        q->insertRawHeader(name.toLower(), value);
-                    }
-                } else {
-                    q->insertRawHeader(name.toLower(), value);
-                }
+    if (!upgrade.isEmpty()) {
+        state = ReadDone;
+        connection->requestUpgrade(q, upgrade, q->url());
+        emit q->upgrade(upgrade, q->url());
+    } else if (!hasContentLength && !chunked) {
+        state = ReadDone;
+        connection->requestReady(q);
+        emit q->ready();
+        connection->requestFinished(q);
+        emit q->finished();
+    } else if (!chunked && isBodyTooLarge(bodyLength)) {
+        // a chunked body is checked as its chunks arrive
+        refuse("413 Payload Too Large");
+    } else {
+        state = ReadBody;
+        if (expectContinue)
+            connection->sendContinue();
+        // the body is delivered by dataReceived() after the request is handed out
+        streaming = connection->settings()->streamRequestBodies;
+        if (streaming) {
+            connection->requestReady(q);
+            emit q->ready();
+        }
+    }
+}
+
+void QHttpRequest::Private::readBody()
+{
+    if (chunked) {
+        readChunkedBody();
+        return;
+    }
+    QHttpConnection *connection = q->connection();
+    int length = qMin<qint64>(bodyLength - bodyRead, connection->buffer().size());
+    if (length > 0) {
+        bodyData(connection->buffer().constData(), length);
+        // the body was refused on the way
+        if (state == ReadDone)
+            return;
+        bodyRead += length;
+        connection->consume(length);
+    }
+    if (bodyRead == bodyLength)
+        bodyDone();
+}
+
+void QHttpRequest::Private::readChunkedBody()
+{
+    QHttpConnection *connection = q->connection();
+    const char *begin = connection->buffer().constData();
+    const char *end = begin + connection->buffer().size();
+    const char *p = begin;
+    bool done = false;
+
+    while (!done && !paused && state != ReadDone && p < end) {
+        switch (chunkState) {
+        case ChunkSize: {
+            const char *lf = qhsFindChar(p, end, '\n');
+            if (isLineTooLong(lf - p)) {
+                connection->consume(p - begin);
+                refuseBody("400 Bad Request", "chunk size line too long.");
+                return;
+            }
+            if (lf == end)
+                goto out;
+            // chunk extensions after ';' are ignored
+            const char *sizeEnd = p;
+            while (sizeEnd < lf && isxdigit(uchar(*sizeEnd)))
+                sizeEnd++;
+            bool ok = sizeEnd > p && sizeEnd - p <= 15;
+            if (ok)
+                chunkRemaining = QByteArray(p, sizeEnd - p).toLongLong(&ok, 16);
+            if (!ok) {
+                connection->consume(p - begin);
+                error("invalid chunk size.");
+                return;
+            }
+            if (isBodyTooLarge(bodyRead + chunkRemaining)) {
+                connection->consume(p - begin);
+                refuseBody("413 Payload Too Large", "request body too large.");
+                return;
             }
+            p = lf + 1;
+            chunkState = chunkRemaining == 0 ? ChunkTrailer : ChunkData;
+            break;
         }
-        break;
-    case ReadBody:
-        if (q->hasRawHeader("Content-Length")) {
-            int length = q->rawHeader("Content-Length").toLongLong();
-            data.append(connection->read(length - data.length()));
-            if (data.length() == length) {
-                QHash<QByteArray, QByteArray> multipartRawHeaders;
-                QByteArray multipartData;
-                if (!multipartBoundary.isEmpty()) {
-                    QByteArray newData;
-                    foreach (QByteArray ba, data.split('\n')) {
-                        switch (state) {
-                        case ReadBody:
-                            ba.chop(1); // \r
-                            if (ba == multipartBoundary) {
-                                state = MultipartHeader;
-                            } else {
-                                qhsWarning() << ba << multipartBoundary;
-                            }
-                            break;
-                        case MultipartHeader:
-                            ba.chop(1); // \r
-                            if (ba.isEmpty()) {
-                                state = MultipartBody;
-                            } else {
-                                int i = ba.indexOf(':');
-                                multipartRawHeaders.insert(ba.left(i), ba.mid(i + 2));
-                            }
-                            break;
-                        case MultipartBody:
-                            if (ba.startsWith(multipartBoundary)) {
-                                ba.chop(1); // \r
-                                if (multipartRawHeaders.contains("Content-Type")) {
-                                    if (multipartData.size() > 0
-                                            && multipartRawHeaders.contains("Content-Disposition")
-                                            && !q->rawHeader("Content-Disposition").contains("filename=\"\"")) {
-                                        files.append(new QHttpFileData(multipartRawHeaders, multipartData, this));
-                                    }
-                                } else {
-                                    QByteArray name = multipartRawHeaders.value("Content-Disposition").split('=').at(1);
-                                    name = name.mid(1, name.length() - 2);
-                                    if (!newData.isEmpty()) {
-                                        newData.append("&");
-                                    }
-                                    newData.append(name);
-                                    newData.append("=");
-                                    multipartData.chop(2);
-                                    newData.append(QUrl::toPercentEncoding(QString::fromUtf8(multipartData)));
-                                }
-                                multipartRawHeaders.clear();
-                                multipartData.clear();
-                                if (ba.endsWith("--")) {
-                                    data = newData;
-                                    state = ReadDone;
-                                } else {
-                                    state = MultipartHeader;
-                                }
-                            } else {
-                                multipartData.append(ba);
-                                multipartData.append("\n");
-                            }
-                            break;
-                        default:
-                            break;
-                        }
-                    }
-                }
-                state = ReadDone;
-                emit q->ready();
+        case ChunkData: {
+            int length = qMin<qint64>(chunkRemaining, end - p);
+            bodyData(p, length);
+            p += length;
+            bodyRead += length;
+            chunkRemaining -= length;
+            if (chunkRemaining == 0)
+                chunkState = ChunkDataEnd;
+            break;
+        }
+        case ChunkDataEnd:
+        case ChunkTrailer: {
+            const char *lf = qhsFindChar(p, end, '\n');
+            if (isLineTooLong(lf - p)) {
+                connection->consume(p - begin);
+                if (chunkState == ChunkTrailer)
+                    refuseBody("431 Request Header Fields Too Large", "chunk trailer too long.");
+                else
+                    refuseBody("400 Bad Request", "chunk data not terminated.");
+                return;
             }
+            if (lf == end)
+                goto out;
+            const char *lineEnd = lf;
+            if (lineEnd > p && lineEnd[-1] == '\r')
+                lineEnd--;
+            if (chunkState == ChunkDataEnd)
+                chunkState = ChunkSize;
+            else if (lineEnd == p)
+                done = true;
+            // trailer fields are skipped
+            p = lf + 1;
+            break;
+        }
+        }
+    }
+
+out:
+    // the body may have been refused on the way, the rest of the buffer does not matter then
+    if (state == ReadDone)
+        return;
+    connection->consume(p - begin);
+    if (done)
+        bodyDone();
+}
+
+// receives the decoded body, in pieces as they arrive
+void QHttpRequest::Private::bodyData(const char *begin, int length)
+{
+    if (streaming) {
+        emit q->dataReceived(QByteArray(begin, length));
+    } else if (multipartBoundary.isEmpty()) {
+        data.append(begin, length);
+    } else if (multipartPending.isEmpty()) {
+        int consumed = parseMultipart(begin, begin + length);
+        if (state != ReadDone)
+            multipartPending = QByteArray(begin + consumed, length - consumed);
+    } else {
+        // bytes left over by the previous piece, like a partial delimiter
+        if (isBodyTooLarge(multipartPending.size() + length)) {
+            refuse("413 Payload Too Large");
+            return;
         }
-        break;
-    default:
-        break;
+        multipartPending.append(begin, length);
+        int consumed = parseMultipart(multipartPending.constData(), multipartPending.constData() + multipartPending.size());
+        multipartPending.remove(0, consumed);
     }
 }
 
-void QHttpRequest::Private::disconnected()
+void QHttpRequest::Private::bodyDone()
 {
-    q->deleteLater();
+    if (!multipartBoundary.isEmpty() && multipartState != MultipartEpilogue)
+        qhsWarning() << "multipart body is not terminated.";
+    // a part which is not terminated is dropped
+    delete multipartFile;
+    multipartFile = 0;
+    multipartPending.clear();
+
+    state = ReadDone;
+    if (!streaming) {
+        q->connection()->requestReady(q);
+        emit q->ready();
+    }
+    q->connection()->requestFinished(q);
+    emit q->finished();
+}
+
+static QByteArray dispositionParameter(const QByteArray &disposition, const QByteArray &parameter)
+{
+    int i = disposition.indexOf(parameter + "=\"");
+    if (i < 0)
+        return QByteArray();
+    i += parameter.length() + 2;
+    int j = disposition.indexOf('"', i);
+    return disposition.mid(i, j < 0 ? -1 : j - i);
+}
+
+// processes the multipart body as it arrives and returns the number of bytes consumed.
+// bytes which may be the beginning of a delimiter are left for the next call.
+int QHttpRequest::Private::parseMultipart(const char *begin, const char *end)
+{
+    const char *p = begin;
+    for (;;) {
+        // refused on the way, what is left is dropped
+        if (state == ReadDone)
+            return end - begin;
+        switch (multipartState) {
+        case MultipartPreamble: {
+            const char *boundary = qhsFindString(p, end, multipartBoundary.constData(), multipartBoundary.length());
+            if (boundary == end)
+                return qMax(p, end - multipartBoundary.length() + 1) - begin;
+            p = boundary + multipartBoundary.length();
+            multipartState = MultipartDelimiter;
+            break;
+        }
+        case MultipartDelimiter: {
+            // "--" after the delimiter closes the body
+            if (end - p < 2)
+                return p - begin;
+            if (p[0] == '-' && p[1] == '-') {
+                multipartState = MultipartEpilogue;
+                break;
+            }
+            const char *lf = qhsFindChar(p, end, '\n');
+            if (isLineTooLong(lf - p)) {
+                refuse("400 Bad Request");
+                break;
+            }
+            if (lf == end)
+                return p - begin;
+            p = lf + 1;
+            multipartRawHeaders.clear();
+            multipartState = MultipartHeader;
+            break;
+        }
+        case MultipartHeader: {
+            const char *lf = qhsFindChar(p, end, '\n');
+            if (isLineTooLong(lf - p)) {
+                refuse("431 Request Header Fields Too Large");
+                break;
+            }
+            if (lf == end)
+                return p - begin;
+            const char *lineEnd = lf;
+            if (lineEnd > p && lineEnd[-1] == '\r')
+                lineEnd--;
+            if (lineEnd == p) {
+                beginPart();
+                multipartState = MultipartBody;
+            } else {
+                const char *colon = qhsFindChar(p, lineEnd, ':');
+                if (colon != lineEnd)
+                    multipartRawHeaders.insert(QByteArray(p, colon - p), QByteArray(colon + 1, lineEnd - colon - 1).trimmed());
+            }
+            p = lf + 1;
+            break;
+        }
+        case MultipartBody: {
+            const char *next = qhsFindString(p, end, multipartDelimiter.constData(), multipartDelimiter.length());
+            if (next == end) {
+                const char *safe = qMax(p, end - multipartDelimiter.length() + 1);
+                writePart(p, safe - p);
+                return safe - begin;
+            }
+            writePart(p, next - p);
+            endPart();
+            p = next + multipartDelimiter.length();
+            multipartState = MultipartDelimiter;
+            break;
+        }
+        case MultipartEpilogue:
+            return end - begin;
+        }
+    }
+}
+
+void QHttpRequest::Private::beginPart()
+{
+    multipartSkip = false;
+    multipartField.clear();
+    if (!multipartRawHeaders.contains("Content-Type"))
+        return;
+
+    QByteArray contentDisposition = multipartRawHeaders.value("Content-Disposition");
+    if (contentDisposition.isEmpty() || contentDisposition.contains("filename=\"\"")) {
+        multipartSkip = true;
+        return;
+    }
+    const QHttpServerSettings *settings = q->connection()->settings();
+    QIODevice *device = 0;
+    if (settings->uploadDeviceFactory)
+        device = settings->uploadDeviceFactory(q, multipartRawHeaders);
+    multipartFile = new QHttpFileData(multipartRawHeaders, device, settings->uploadMemoryThreshold, this);
+    multipartFileSize = 0;
+}
+
+void QHttpRequest::Private::writePart(const char *data, int length)
+{
+    if (length == 0 || multipartSkip)
+        return;
+    if (multipartFile) {
+        multipartFile->write(data, length);
+        multipartFileSize += length;
+    } else if (isBodyTooLarge(multipartField.size() + length)) {
+        refuse("413 Payload Too Large");
+    } else
+        multipartField.append(data, length);
+}
+
+void QHttpRequest::Private::endPart()
+{
+    if (multipartFile) {
+        multipartFile->close();
+        if (multipartFileSize > 0) {
+            multipartFile->open(QIODevice::ReadOnly);
+            files.append(multipartFile);
+        } else {
+            delete multipartFile;
+        }
+        multipartFile = 0;
+    } else if (!multipartSkip) {
+        // form fields become the url encoded body of the request
+        QByteArray name = dispositionParameter(multipartRawHeaders.value("Content-Disposition"), "name");
+        if (!data.isEmpty()) {
+            data.append("&");
+        }
+        data.append(name);
+        data.append("=");
+        data.append(QUrl::toPercentEncoding(QString::fromUtf8(multipartField)));
+        multipartField.clear();
+    }
 }
 
 QHttpRequest::QHttpRequest(QHttpConnection *parent)
@@ -283,23 +895,95 @@ QHttpRequest::QHttpRequest(QHttpConnection *parent)
 {
 }
 
+QHttpRequest::~QHttpRequest()
+{
+    if (connection())
+        connection()->requestDestroyed(this);
+}
+
+void QHttpRequest::readRequest()
+{
+    d->readyRead();
+}
+
+void QHttpRequest::recycle()
+{
+    disconnect(this, 0, 0, 0);
+    const QObjectList objects = children();
+    foreach (QObject *object, objects) {
+        if (object != d)
+            delete object;
+    }
+    QBuffer::close();
+    d->recycle();
+    recycleRequest();
+    open(QIODevice::ReadOnly);
+}
+
+bool QHttpRequest::isWaitingForHead() const
+{
+    return d->state == Private::ReadRequestLine || d->state == Private::ReadHeaders;
+}
+
+// nothing is expected while the application holds the body back
+bool QHttpRequest::isWaitingForBody() const
+{
+    return d->state == Private::ReadBody && !d->paused;
+}
+
 const QUrl &QHttpRequest::url() const
 {
+    if (!d->urlBuilt)
+        d->buildUrl();
     return d->url;
 }
 
 void QHttpRequest::setUrl(const QUrl &url)
 {
-    if (d->url == url) return;
+    if (this->url() == url) return;
     d->url = url;
     emit urlChanged(url);
 }
 
+bool QHttpRequest::isStreaming() const
+{
+    return d->streaming;
+}
+
+void QHttpRequest::pause()
+{
+    if (d->paused || d->state == Private::ReadDone) return;
+    d->paused = true;
+    // the socket stops reading once its buffer is full and the peer is throttled by TCP
+    if (connection()->readBufferSize() == 0)
+        connection()->setReadBufferSize(64 * 1024);
+    connection()->readStateChanged();
+}
+
+void QHttpRequest::resume()
+{
+    if (!d->paused) return;
+    d->paused = false;
+    connection()->setReadBufferSize(connection()->settings()->readBufferSize);
+    connection()->readStateChanged();
+    QMetaObject::invokeMethod(d, "readyRead", Qt::QueuedConnection);
+}
+
 const QByteArray &QHttpRequest::method() const
 {
     return d->method;
 }
 
+const QByteArray &QHttpRequest::httpVersion() const
+{
+    return d->httpVersion;
+}
+
+const QByteArray &QHttpRequest::target() const
+{
+    return d->target;
+}
+
 const QList<QHttpFileData *> &QHttpRequest::files() const
 {
     return d->files;
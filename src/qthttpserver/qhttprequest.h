@@ -35,47 +35,89 @@
 
 QT_BEGIN_NAMESPACE
 
-class Q_HTTPSERVER_EXPORT QHttpFileData : public QBuffer
+class Q_HTTPSERVER_EXPORT QHttpFileData : public QIODevice
 {
     Q_OBJECT
     Q_PROPERTY(QString fileName READ fileName NOTIFY fileNameChanged)
     Q_PROPERTY(QString contentType READ contentType NOTIFY contentTypeChanged)
 public:
     QHttpFileData(const QHash<QByteArray, QByteArray> &rawHeaders, const QByteArray &data, QObject *parent = Q_NULLPTR);
+    // the content is written with write(), it is kept in memory up to memoryThreshold bytes and
+    // moved to a temporary file beyond that. when device is given, the content is written to it instead
+    QHttpFileData(const QHash<QByteArray, QByteArray> &rawHeaders, QIODevice *device, qint64 memoryThreshold, QObject *parent = Q_NULLPTR);
     ~QHttpFileData();
     const QString &fileName() const;
     const QString &contentType() const;
 
+    // QBuffer or QTemporaryFile holding the content, or the device given to the constructor
+    QIODevice *device() const;
+
+    bool open(OpenMode mode);
+    bool isSequential() const;
+    qint64 size() const;
+    bool seek(qint64 pos);
+
 Q_SIGNALS:
     void fileNameChanged(const QString &fileName);
     void contentTypeChanged(const QString &contentType);
 
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
 private:
     class Private;
     Private *d;
     Q_DISABLE_COPY(QHttpFileData)
 };
 
+// a request belongs to the connection it arrived on. once its reply is done the connection
+// may reuse the object for a later request on the same connection, never on another one,
+// so do not keep the pointer or connections made to it beyond that point
 class Q_HTTPSERVER_EXPORT QHttpRequest : public QBuffer, public QAbstractRequest
 {
     Q_OBJECT
 public:
     explicit QHttpRequest(QHttpConnection *parent);
+    ~QHttpRequest();
 
     const QByteArray &method() const;
+    const QByteArray &httpVersion() const;
+    // the request-target as it was received, the path is not decoded
+    const QByteArray &target() const;
     const QList<QHttpFileData *> &files() const;
 
     const QUrl &url() const;
 
+    // when the server streams request bodies, ready() is emitted once the headers are read
+    // and the body is delivered by dataReceived() instead of being buffered
+    bool isStreaming() const;
+
 public Q_SLOTS:
     void setUrl(const QUrl &url);
 
+    // stops reading the body from the socket until resume() is called
+    void pause();
+    void resume();
+
 Q_SIGNALS:
     void urlChanged(const QUrl &url);
-    void upgrade(const QByteArray &to, const QUrl &url, const QHash<QByteArray, QByteArray> &rawHeaders);
+    // the headers are handed over to the request object created for the upgrade
+    void upgrade(const QByteArray &to, const QUrl &url);
     void ready();
+    void dataReceived(const QByteArray &data);
+    void finished();
 
 private:
+    // the connection feeds the request and reuses it for the next one once
+    // its reply is done, connections made to it are dropped at that point
+    friend class QHttpConnection;
+    void readRequest();
+    void recycle();
+    // what is still expected from the client, for the read timeouts
+    bool isWaitingForHead() const;
+    bool isWaitingForBody() const;
+
     class Private;
     Private *d;
     Q_DISABLE_COPY(QHttpRequest)
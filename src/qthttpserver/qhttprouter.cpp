@@ -0,0 +1,115 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "qhttprouter.h"
+
+#include "qhttprequest.h"
+#include "qhttpreply.h"
+#include "qhttproutetree_p.h"
+#include "qhttpserver_logging.h"
+
+class QHttpRouter::Private
+{
+public:
+    bool dispatch(QHttpRequest *request, QHttpReply *reply, QHttpRouteTree::Match *m) const;
+
+    QHttpRouteTree tree;
+    Handler notFoundHandler;
+};
+
+// hands the request to its route, m holds what the path matched when there is none
+bool QHttpRouter::Private::dispatch(QHttpRequest *request, QHttpReply *reply, QHttpRouteTree::Match *m) const
+{
+    const QHttpRouteTree::Route *route = tree.find(request->method(), request->target(), m);
+    if (!route)
+        return false;
+    route->handler(request, reply, QHttpRouteTree::parameters(*m));
+    return true;
+}
+
+QHttpRouter::QHttpRouter(QObject *parent)
+    : QObject(parent)
+    , d(new Private)
+{
+}
+
+QHttpRouter::~QHttpRouter()
+{
+    delete d;
+}
+
+bool QHttpRouter::addRoute(const QByteArray &method, const QByteArray &pattern, const Handler &handler)
+{
+    if (!pattern.startsWith('/') || !handler) {
+        qhsWarning() << "invalid route" << method << pattern;
+        return false;
+    }
+    return d->tree.insert(method, pattern, handler);
+}
+
+void QHttpRouter::setNotFoundHandler(const Handler &handler)
+{
+    d->notFoundHandler = handler;
+}
+
+bool QHttpRouter::route(QHttpRequest *request, QHttpReply *reply) const
+{
+    QHttpRouteTree::Match m;
+    return d->dispatch(request, reply, &m);
+}
+
+void QHttpRouter::handleRequest(QHttpRequest *request, QHttpReply *reply)
+{
+    QHttpRouteTree::Match m;
+    if (d->dispatch(request, reply, &m))
+        return;
+    if (m.pathMatch) {
+        QByteArray allow;
+        bool get = false;
+        bool head = false;
+        foreach (const QHttpRouteTree::Route &allowed, m.pathMatch->routes) {
+            if (!allow.isEmpty())
+                allow += ", ";
+            allow += allowed.method;
+            get = get || allowed.method == "GET";
+            head = head || allowed.method == "HEAD";
+        }
+        // HEAD is answered by the GET route
+        if (get && !head)
+            allow += ", HEAD";
+        reply->setStatus(405);
+        reply->setRawHeader("Allow", allow);
+        reply->close();
+        return;
+    }
+    if (d->notFoundHandler) {
+        d->notFoundHandler(request, reply, Parameters());
+        return;
+    }
+    reply->setStatus(404);
+    reply->close();
+}
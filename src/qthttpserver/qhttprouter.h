@@ -0,0 +1,87 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPROUTER_H
+#define QHTTPROUTER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+
+#include <functional>
+
+#include "qthttpserverglobal.h"
+
+class QHttpRequest;
+class QHttpReply;
+
+QT_BEGIN_NAMESPACE
+
+// dispatches requests to handlers by method and path. the routes are kept in a radix tree
+// which is walked over the raw bytes of the request-target, so looking up a route does not
+// depend on the number of routes and does not build a QUrl.
+//
+// a pattern is a path made of literal segments, ":name" segments which match any one
+// segment and an optional "*name" at the end which matches the rest of the path.
+// literal segments win over parameters and parameters over the rest of the path.
+// HEAD requests go to the GET route of a path when it has no HEAD route.
+// connect incomingConnection() of the server to handleRequest() with Qt::DirectConnection,
+// routes have to be added before the server handles requests on worker threads
+class Q_HTTPSERVER_EXPORT QHttpRouter : public QObject
+{
+    Q_OBJECT
+public:
+    // the values of the parameters of the pattern, percent-decoded
+    typedef QHash<QByteArray, QByteArray> Parameters;
+    typedef std::function<void (QHttpRequest *request, QHttpReply *reply, const Parameters &parameters)> Handler;
+
+    explicit QHttpRouter(QObject *parent = Q_NULLPTR);
+    ~QHttpRouter();
+
+    // an empty method matches any method. false when the pattern is invalid or names a
+    // parameter differently than a route added before at the same place
+    bool addRoute(const QByteArray &method, const QByteArray &pattern, const Handler &handler);
+
+    // called for requests without a route instead of replying 404 Not Found
+    void setNotFoundHandler(const Handler &handler);
+
+    // calls the handler of the route of the request, false when there is none
+    bool route(QHttpRequest *request, QHttpReply *reply) const;
+
+public Q_SLOTS:
+    // routes the request, replies 404 Not Found or 405 Method Not Allowed without a route.
+    // the Allow header of a 405 lists HEAD along with GET
+    void handleRequest(QHttpRequest *request, QHttpReply *reply);
+
+private:
+    class Private;
+    Private *d;
+    Q_DISABLE_COPY(QHttpRouter)
+};
+
+QT_END_NAMESPACE
+
+#endif // QHTTPROUTER_H
@@ -0,0 +1,219 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "qhttproutetree_p.h"
+
+#include "qhttpscan_p.h"
+#include "qhttpserver_logging.h"
+
+#include <string.h>
+
+// follows the literal down the tree as far as it is there, splitting the node where
+// it departs from a prefix, and adds the rest as a new node
+QHttpRouteTree::Node *QHttpRouteTree::insertLiteral(Node *node, const char *literal, int length)
+{
+    while (length > 0) {
+        int i = node->indices.indexOf(*literal);
+        if (i < 0) {
+            Node *child = new Node;
+            child->prefix = QByteArray(literal, length);
+            node->indices.append(*literal);
+            node->children.append(child);
+            return child;
+        }
+        Node *child = node->children.at(i);
+        int common = 0;
+        int max = qMin(length, child->prefix.size());
+        while (common < max && literal[common] == child->prefix.at(common))
+            common++;
+        if (common < child->prefix.size()) {
+            Node *split = new Node;
+            split->prefix = child->prefix.left(common);
+            child->prefix.remove(0, common);
+            split->indices.append(child->prefix.at(0));
+            split->children.append(child);
+            node->children[i] = split;
+            child = split;
+        }
+        literal += common;
+        length -= common;
+        node = child;
+    }
+    return node;
+}
+
+bool QHttpRouteTree::insert(const QByteArray &method, const QByteArray &pattern, const Handler &handler)
+{
+    Node *node = &root;
+    const char *p = pattern.constData();
+    const char *end = p + pattern.size();
+    while (p < end) {
+        // a parameter starts a segment, ':' and '*' elsewhere are literal
+        const char *literal = p;
+        while (p < end && !((*p == ':' || *p == '*') && p[-1] == '/'))
+            p++;
+        node = insertLiteral(node, literal, p - literal);
+        if (p == end)
+            break;
+
+        const char *segmentEnd = qhsFindChar(p, end, '/');
+        QByteArray name(p + 1, segmentEnd - p - 1);
+        Node **child = 0;
+        if (*p == ':') {
+            if (name.isEmpty()) {
+                qhsWarning() << "parameter without a name in route" << pattern;
+                return false;
+            }
+            child = &node->param;
+        } else {
+            if (segmentEnd != end) {
+                qhsWarning() << "wildcard has to end the route" << pattern;
+                return false;
+            }
+            child = &node->wildcard;
+        }
+        if (!*child) {
+            *child = new Node;
+            (*child)->name = name;
+        } else if ((*child)->name != name) {
+            qhsWarning() << "route" << pattern << "names parameter" << name << "which is" << (*child)->name << "in another route";
+            return false;
+        }
+        node = *child;
+        p = segmentEnd;
+    }
+
+    for (int i = 0; i < node->routes.size(); i++) {
+        if (node->routes.at(i).method == method) {
+            node->routes[i].handler = handler;
+            return true;
+        }
+    }
+    Route route;
+    route.method = method;
+    route.handler = handler;
+    node->routes.append(route);
+    return true;
+}
+
+// the path of an origin-form or absolute-form request-target without the query
+const QHttpRouteTree::Route *QHttpRouteTree::find(const QByteArray &method, const QByteArray &target, Match *m) const
+{
+    static const char slash = '/';
+    const char *p = target.constData();
+    const char *end = p + target.size();
+    if (p < end && *p != '/') {
+        // the path starts after the authority
+        const char *authority = qhsFindString(p, end, "://", 3);
+        if (authority == end)
+            return 0;
+        p = qhsFindChar(authority + 3, end, '/');
+        if (p == end) {
+            p = &slash;
+            end = p + 1;
+        }
+    }
+    m->method = method;
+    m->end = qhsFindChar(p, end, '?');
+    return match(&root, p, m);
+}
+
+// node has matched the path up to p. literal children are tried before the parameter and the
+// parameter before the wildcard, the next one is tried when the rest of the path does not match
+const QHttpRouteTree::Route *QHttpRouteTree::match(const Node *node, const char *p, Match *m) const
+{
+    const Route *route = 0;
+    if (p == m->end) {
+        route = findRoute(node, m);
+        if (route)
+            return route;
+    } else {
+        int i = node->indices.indexOf(*p);
+        if (i >= 0) {
+            const Node *child = node->children.at(i);
+            int length = child->prefix.size();
+            if (m->end - p >= length && memcmp(p, child->prefix.constData(), length) == 0) {
+                route = match(child, p + length, m);
+                if (route)
+                    return route;
+            }
+        }
+        if (node->param) {
+            const char *segmentEnd = qhsFindChar(p, m->end, '/');
+            if (segmentEnd > p) {
+                Capture capture = { node->param, p, segmentEnd };
+                m->captures.append(capture);
+                route = match(node->param, segmentEnd, m);
+                if (route)
+                    return route;
+                m->captures.removeLast();
+            }
+        }
+    }
+    if (node->wildcard) {
+        Capture capture = { node->wildcard, p, m->end };
+        m->captures.append(capture);
+        route = findRoute(node->wildcard, m);
+        if (route)
+            return route;
+        m->captures.removeLast();
+    }
+    return 0;
+}
+
+const QHttpRouteTree::Route *QHttpRouteTree::findRoute(const Node *node, Match *m) const
+{
+    const Route *any = 0;
+    const Route *get = 0;
+    for (int i = 0; i < node->routes.size(); i++) {
+        const Route &route = node->routes.at(i);
+        if (route.method == m->method)
+            return &route;
+        if (route.method.isEmpty())
+            any = &route;
+        else if (route.method == "GET")
+            get = &route;
+    }
+    // HEAD without a route of its own is answered like GET, the reply leaves out the body
+    if (get && m->method == "HEAD")
+        return get;
+    if (!any && !node->routes.isEmpty() && !m->pathMatch)
+        m->pathMatch = node;
+    return any;
+}
+
+QHttpRouteTree::Parameters QHttpRouteTree::parameters(const Match &m)
+{
+    Parameters ret;
+    for (int i = 0; i < m.captures.size(); i++) {
+        const Capture &capture = m.captures.at(i);
+        if (capture.node->name.isEmpty())
+            continue;
+        ret.insert(capture.node->name, QByteArray::fromPercentEncoding(QByteArray::fromRawData(capture.begin, capture.end - capture.begin)));
+    }
+    return ret;
+}
@@ -0,0 +1,103 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPROUTETREE_H
+#define QHTTPROUTETREE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QVector>
+
+#include "qhttprouter.h"
+
+// the radix tree of QHttpRouter. it works on the method and the raw request-target only,
+// so it is usable without a connection
+class QHttpRouteTree
+{
+public:
+    typedef QHttpRouter::Handler Handler;
+    typedef QHttpRouter::Parameters Parameters;
+
+    struct Route
+    {
+        QByteArray method;
+        Handler handler;
+    };
+
+    // a node matches its prefix byte by byte, a parameter node one path segment and
+    // a wildcard node the rest of the path. their children continue after that
+    struct Node
+    {
+        Node() : param(0), wildcard(0) {}
+        ~Node() { qDeleteAll(children); delete param; delete wildcard; }
+
+        QByteArray prefix;
+        // the first byte of the prefix of each child
+        QByteArray indices;
+        QVector<Node *> children;
+        // of a parameter or wildcard node
+        QByteArray name;
+        Node *param;
+        Node *wildcard;
+        QVector<Route> routes;
+    };
+
+    // a parameter value as it appears in the path
+    struct Capture
+    {
+        const Node *node;
+        const char *begin;
+        const char *end;
+    };
+
+    struct Match
+    {
+        Match() : pathMatch(0) {}
+
+        QByteArray method;
+        const char *end;
+        QVarLengthArray<Capture, 8> captures;
+        // a node the path ends at which has routes for other methods only
+        const Node *pathMatch;
+    };
+
+    // pattern starts with '/'. false when a parameter has no name, a wildcard does not end the
+    // pattern or a parameter is named differently than in a pattern inserted before
+    bool insert(const QByteArray &method, const QByteArray &pattern, const Handler &handler);
+    // the route of method and the path of target, m holds what the path matched
+    const Route *find(const QByteArray &method, const QByteArray &target, Match *m) const;
+    static Parameters parameters(const Match &m);
+
+private:
+    Node *insertLiteral(Node *node, const char *literal, int length);
+    const Route *match(const Node *node, const char *p, Match *m) const;
+    const Route *findRoute(const Node *node, Match *m) const;
+
+    Node root;
+};
+
+#endif // QHTTPROUTETREE_H
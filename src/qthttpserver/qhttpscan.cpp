@@ -0,0 +1,152 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "qhttpscan_p.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define QHS_HAVE_SSE2
+#  include <emmintrin.h>
+#  if defined(Q_CC_CLANG) || (defined(Q_CC_GNU) && !defined(Q_CC_INTEL) && Q_CC_GNU >= 409)
+#    define QHS_HAVE_AVX2
+#    include <immintrin.h>
+#  endif
+#endif
+
+static inline uint countTrailingZeroBits(uint v)
+{
+#if defined(Q_CC_GNU)
+    return __builtin_ctz(v);
+#else
+    uint ret = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        ret++;
+    }
+    return ret;
+#endif
+}
+
+static const char *findCharScalar(const char *begin, const char *end, char c)
+{
+    if (begin >= end)
+        return end;
+    const char *ret = static_cast<const char *>(memchr(begin, c, end - begin));
+    return ret ? ret : end;
+}
+
+static const char *findStringScalar(const char *begin, const char *end, const char *needle, int needleLength)
+{
+    const char *last = end - needleLength;
+    while (begin <= last) {
+        begin = findCharScalar(begin, last + 1, needle[0]);
+        if (begin > last)
+            break;
+        if (memcmp(begin + 1, needle + 1, needleLength - 1) == 0)
+            return begin;
+        begin++;
+    }
+    return end;
+}
+
+#if defined(QHS_HAVE_SSE2)
+// compares the first and the last byte of the needle for 16 positions at once
+// and only runs memcmp on the candidates
+static const char *findStringSse2(const char *begin, const char *end, const char *needle, int needleLength)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+    for (; begin + needleLength - 1 + 16 <= end; begin += 16) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin + needleLength - 1));
+        uint mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+        while (mask) {
+            uint i = countTrailingZeroBits(mask);
+            if (memcmp(begin + i + 1, needle + 1, needleLength - 2) == 0)
+                return begin + i;
+            mask &= mask - 1;
+        }
+    }
+    return findStringScalar(begin, end, needle, needleLength);
+}
+#endif
+
+#if defined(QHS_HAVE_AVX2)
+__attribute__((target("avx2")))
+static const char *findStringAvx2(const char *begin, const char *end, const char *needle, int needleLength)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+    for (; begin + needleLength - 1 + 32 <= end; begin += 32) {
+        __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+        __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin + needleLength - 1));
+        uint mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+        while (mask) {
+            uint i = countTrailingZeroBits(mask);
+            if (memcmp(begin + i + 1, needle + 1, needleLength - 2) == 0)
+                return begin + i;
+            mask &= mask - 1;
+        }
+    }
+    return findStringSse2(begin, end, needle, needleLength);
+}
+#endif
+
+typedef const char *(*FindString)(const char *, const char *, const char *, int);
+
+static FindString detectFindString()
+{
+    FindString ret = findStringScalar;
+#if defined(QHS_HAVE_SSE2)
+    ret = findStringSse2;
+#endif
+#if defined(QHS_HAVE_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+        ret = findStringAvx2;
+#endif
+    return ret;
+}
+
+// the C library's memchr() is already vectorized and unrolled, a block at a time loop
+// here was slower than it
+const char *qhsFindChar(const char *begin, const char *end, char c)
+{
+    return findCharScalar(begin, end, c);
+}
+
+const char *qhsFindString(const char *begin, const char *end, const char *needle, int needleLength)
+{
+    if (needleLength <= 0)
+        return begin;
+    if (end - begin < needleLength)
+        return end;
+    if (needleLength == 1)
+        return findCharScalar(begin, end, needle[0]);
+    static const FindString findString = detectFindString();
+    return findString(begin, end, needle, needleLength);
+}
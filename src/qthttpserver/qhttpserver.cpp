@@ -26,56 +26,220 @@
 
 #include "qhttpserver.h"
 
+#include <QtCore/QThread>
 #include <QtNetwork/QTcpServer>
 
+#include "qhttpadmission_p.h"
 #include "qhttpconnection_p.h"
+#include "qhttpworker_p.h"
+#include "qhttpserversettings_p.h"
+#include "qhttpserver_logging.h"
 
 class QHttpServer::Private : public QTcpServer
 {
     Q_OBJECT
 public:
     explicit Private(QHttpServer *parent);
+    ~Private();
+
+    void startWorkers();
+    void stopWorkers();
+
+    bool listenReusePort(const QHostAddress &address, quint16 port);
+    void closeReusePort();
 
 protected:
     void incomingConnection(qintptr socketDescriptor);
 
+private slots:
+    void updateAccepting();
+
 private:
+    QHttpWorker *nextWorker();
+
     QHttpServer *q;
+
+public:
+    int workerCount;
+    DispatchPolicy dispatchPolicy;
+    QList<QThread *> threads;
+    QList<QHttpWorker *> workers;
+    int nextWorkerIndex;
+
+    bool reusePort;
+    bool reusePortListening;
+    QHostAddress reusePortAddress;
+    quint16 reusePortPort;
+    QAbstractSocket::SocketError reusePortError;
+    QString reusePortErrorString;
+
+    QHttpServerSettings settings;
+    // connections handled on this thread when there are no workers
+    QHttpLoad threadLoad;
 };
 
 QHttpServer::Private::Private(QHttpServer *parent)
     : QTcpServer(parent)
     , q(parent)
+    , workerCount(0)
+    , dispatchPolicy(RoundRobin)
+    , nextWorkerIndex(0)
+    , reusePort(false)
+    , reusePortListening(false)
+    , reusePortPort(0)
+    , reusePortError(QAbstractSocket::UnknownSocketError)
 {
+    qRegisterMetaType<qintptr>("qintptr");
     setMaxPendingConnections(1000);
+    settings.admission = new QHttpAdmission(&settings, this);
+    connect(settings.admission, SIGNAL(fullChanged()), this, SLOT(updateAccepting()));
+}
+
+QHttpServer::Private::~Private()
+{
+    // connections release their admission on deletion, which has to outlive them
+    qDeleteAll(findChildren<QHttpConnection *>(QString(), Qt::FindDirectChildrenOnly));
+}
+
+void QHttpServer::Private::startWorkers()
+{
+    while (workers.length() < workerCount) {
+        QThread *thread = new QThread;
+        thread->setObjectName(QStringLiteral("QHttpServer worker %1").arg(workers.length()));
+        workers.append(new QHttpWorker(q, &settings, thread));
+        threads.append(thread);
+        thread->start();
+    }
+}
+
+void QHttpServer::Private::stopWorkers()
+{
+    // workers and their connections are deleted on their own threads when the threads finish
+    foreach (QThread *thread, threads) {
+        thread->quit();
+    }
+    foreach (QThread *thread, threads) {
+        thread->wait();
+        delete thread;
+    }
+    threads.clear();
+    workers.clear();
+}
+
+bool QHttpServer::Private::listenReusePort(const QHostAddress &address, quint16 port)
+{
+    if (reusePortListening) {
+        qhsWarning() << "already listening.";
+        return false;
+    }
+    reusePortErrorString.clear();
+    foreach (QHttpWorker *worker, workers) {
+        qintptr socketDescriptor = QHttpListener::openReusePortSocket(address, &port, &reusePortError, &reusePortErrorString);
+        bool listening = false;
+        if (socketDescriptor != -1) {
+            QMetaObject::invokeMethod(worker, "listen", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, listening), Q_ARG(qintptr, socketDescriptor));
+            if (!listening) {
+                reusePortError = QAbstractSocket::UnknownSocketError;
+                reusePortErrorString = QStringLiteral("failed to listen on the socket");
+            }
+        }
+        if (!listening) {
+            closeReusePort();
+            return false;
+        }
+    }
+    reusePortListening = true;
+    reusePortAddress = address;
+    reusePortPort = port;
+    return true;
+}
+
+void QHttpServer::Private::closeReusePort()
+{
+    foreach (QHttpWorker *worker, workers) {
+        QMetaObject::invokeMethod(worker, "close", Qt::BlockingQueuedConnection);
+    }
+    reusePortListening = false;
+}
+
+QHttpWorker *QHttpServer::Private::nextWorker()
+{
+    switch (dispatchPolicy) {
+    case LeastLoaded: {
+        QHttpWorker *ret = workers.first();
+        foreach (QHttpWorker *worker, workers) {
+            if (worker->load() < ret->load())
+                ret = worker;
+        }
+        return ret; }
+    default:
+        nextWorkerIndex = (nextWorkerIndex + 1) % workers.length();
+        return workers.at(nextWorkerIndex);
+    }
 }
 
 void QHttpServer::Private::incomingConnection(qintptr socketDescriptor)
 {
-    QHttpConnection *connection = new QHttpConnection(socketDescriptor, this);
+    QHttpAdmission *admission = settings.admission;
+    if (!workers.isEmpty()) {
+        // a worker at its own limit passes the connection on to the next one
+        for (int i = 0; i < workers.length() && !admission->isFull(); i++) {
+            QHttpWorker *worker = nextWorker();
+            if (worker->admit()) {
+                worker->dispatch(socketDescriptor);
+                return;
+            }
+        }
+        admission->refuseConnection(socketDescriptor);
+        return;
+    }
+    if (!admission->admitConnection(&threadLoad)) {
+        admission->refuseConnection(socketDescriptor);
+        return;
+    }
+    QHttpConnection *connection = new QHttpConnection(socketDescriptor, &settings, &threadLoad, this);
     connect(connection, SIGNAL(ready(QHttpRequest *, QHttpReply *)), q, SIGNAL(incomingConnection(QHttpRequest *, QHttpReply *)));
     connect(connection, SIGNAL(ready(QWebSocket *)), q, SIGNAL(incomingConnection(QWebSocket *)));
 }
 
+void QHttpServer::Private::updateAccepting()
+{
+    settings.admission->updateAccepting(this);
+}
+
 QHttpServer::QHttpServer(QObject *parent)
     : QObject(parent)
     , d(new Private(this))
 {
 }
 
+QHttpServer::~QHttpServer()
+{
+    close();
+    d->stopWorkers();
+}
+
 bool QHttpServer::listen(const QHostAddress &address, quint16 port)
 {
+    d->startWorkers();
+    if (d->reusePort && !d->workers.isEmpty()) {
+        if (QHttpListener::isReusePortSupported())
+            return d->listenReusePort(address, port);
+        qhsWarning() << "SO_REUSEPORT is not supported, connections are accepted on a single thread.";
+    }
     return d->listen(address, port);
 }
 
 void QHttpServer::close()
 {
+    if (d->reusePortListening)
+        d->closeReusePort();
     d->close();
 }
 
 bool QHttpServer::isListening() const
 {
-    return d->isListening();
+    return d->reusePortListening || d->isListening();
 }
 
 void QHttpServer::setMaxPendingConnections(int maxPendingConnections)
@@ -90,23 +254,441 @@ int QHttpServer::maxPendingConnections() const
     return d->maxPendingConnections();
 }
 
+void QHttpServer::setWorkerCount(int workerCount)
+{
+    if (d->workerCount == workerCount) return;
+    if (!d->workers.isEmpty()) {
+        qhsWarning() << "worker count can not be changed once the workers are started.";
+        return;
+    }
+    d->workerCount = qMax(0, workerCount);
+    emit workerCountChanged(d->workerCount);
+}
+
+int QHttpServer::workerCount() const
+{
+    return d->workerCount;
+}
+
+void QHttpServer::setDispatchPolicy(DispatchPolicy dispatchPolicy)
+{
+    if (d->dispatchPolicy == dispatchPolicy) return;
+    d->dispatchPolicy = dispatchPolicy;
+    emit dispatchPolicyChanged(dispatchPolicy);
+}
+
+QHttpServer::DispatchPolicy QHttpServer::dispatchPolicy() const
+{
+    return d->dispatchPolicy;
+}
+
+void QHttpServer::setReusePort(bool reusePort)
+{
+    if (d->reusePort == reusePort) return;
+    d->reusePort = reusePort;
+    emit reusePortChanged(reusePort);
+}
+
+bool QHttpServer::reusePort() const
+{
+    return d->reusePort;
+}
+
+void QHttpServer::setUploadMemoryThreshold(qint64 uploadMemoryThreshold)
+{
+    if (d->settings.uploadMemoryThreshold == uploadMemoryThreshold) return;
+    d->settings.uploadMemoryThreshold = uploadMemoryThreshold;
+    emit uploadMemoryThresholdChanged(uploadMemoryThreshold);
+}
+
+qint64 QHttpServer::uploadMemoryThreshold() const
+{
+    return d->settings.uploadMemoryThreshold;
+}
+
+void QHttpServer::setUploadDeviceFactory(const UploadDeviceFactory &uploadDeviceFactory)
+{
+    d->settings.uploadDeviceFactory = uploadDeviceFactory;
+}
+
+void QHttpServer::setStreamRequestBodies(bool streamRequestBodies)
+{
+    if (d->settings.streamRequestBodies == streamRequestBodies) return;
+    d->settings.streamRequestBodies = streamRequestBodies;
+    emit streamRequestBodiesChanged(streamRequestBodies);
+}
+
+bool QHttpServer::streamRequestBodies() const
+{
+    return d->settings.streamRequestBodies;
+}
+
+void QHttpServer::setMaxRequestsPerConnection(int maxRequestsPerConnection)
+{
+    if (d->settings.maxRequestsPerConnection == maxRequestsPerConnection) return;
+    d->settings.maxRequestsPerConnection = maxRequestsPerConnection;
+    emit maxRequestsPerConnectionChanged(maxRequestsPerConnection);
+}
+
+int QHttpServer::maxRequestsPerConnection() const
+{
+    return d->settings.maxRequestsPerConnection;
+}
+
+void QHttpServer::setKeepAliveTimeout(int keepAliveTimeout)
+{
+    if (d->settings.keepAliveTimeout == keepAliveTimeout) return;
+    d->settings.keepAliveTimeout = keepAliveTimeout;
+    emit keepAliveTimeoutChanged(keepAliveTimeout);
+}
+
+int QHttpServer::keepAliveTimeout() const
+{
+    return d->settings.keepAliveTimeout;
+}
+
+void QHttpServer::setHeaderTimeout(int headerTimeout)
+{
+    if (d->settings.headerTimeout == headerTimeout) return;
+    d->settings.headerTimeout = headerTimeout;
+    emit headerTimeoutChanged(headerTimeout);
+}
+
+int QHttpServer::headerTimeout() const
+{
+    return d->settings.headerTimeout;
+}
+
+void QHttpServer::setBodyTimeout(int bodyTimeout)
+{
+    if (d->settings.bodyTimeout == bodyTimeout) return;
+    d->settings.bodyTimeout = bodyTimeout;
+    emit bodyTimeoutChanged(bodyTimeout);
+}
+
+int QHttpServer::bodyTimeout() const
+{
+    return d->settings.bodyTimeout;
+}
+
+void QHttpServer::setWriteTimeout(int writeTimeout)
+{
+    if (d->settings.writeTimeout == writeTimeout) return;
+    d->settings.writeTimeout = writeTimeout;
+    emit writeTimeoutChanged(writeTimeout);
+}
+
+int QHttpServer::writeTimeout() const
+{
+    return d->settings.writeTimeout;
+}
+
+void QHttpServer::setMaxRequestLineLength(int maxRequestLineLength)
+{
+    if (d->settings.maxRequestLineLength == maxRequestLineLength) return;
+    d->settings.maxRequestLineLength = maxRequestLineLength;
+    emit maxRequestLineLengthChanged(maxRequestLineLength);
+}
+
+int QHttpServer::maxRequestLineLength() const
+{
+    return d->settings.maxRequestLineLength;
+}
+
+void QHttpServer::setMaxHeaderSize(int maxHeaderSize)
+{
+    if (d->settings.maxHeaderSize == maxHeaderSize) return;
+    d->settings.maxHeaderSize = maxHeaderSize;
+    emit maxHeaderSizeChanged(maxHeaderSize);
+}
+
+int QHttpServer::maxHeaderSize() const
+{
+    return d->settings.maxHeaderSize;
+}
+
+void QHttpServer::setMaxHeaderCount(int maxHeaderCount)
+{
+    if (d->settings.maxHeaderCount == maxHeaderCount) return;
+    d->settings.maxHeaderCount = maxHeaderCount;
+    emit maxHeaderCountChanged(maxHeaderCount);
+}
+
+int QHttpServer::maxHeaderCount() const
+{
+    return d->settings.maxHeaderCount;
+}
+
+void QHttpServer::setMaxBodySize(qint64 maxBodySize)
+{
+    if (d->settings.maxBodySize == maxBodySize) return;
+    d->settings.maxBodySize = maxBodySize;
+    emit maxBodySizeChanged(maxBodySize);
+}
+
+qint64 QHttpServer::maxBodySize() const
+{
+    return d->settings.maxBodySize;
+}
+
+void QHttpServer::setReadBufferSize(int readBufferSize)
+{
+    if (d->settings.readBufferSize == readBufferSize) return;
+    d->settings.readBufferSize = readBufferSize;
+    emit readBufferSizeChanged(readBufferSize);
+}
+
+int QHttpServer::readBufferSize() const
+{
+    return d->settings.readBufferSize;
+}
+
+void QHttpServer::setMaxConnections(int maxConnections)
+{
+    if (d->settings.maxConnections == maxConnections) return;
+    d->settings.maxConnections = maxConnections;
+    d->settings.admission->limitsChanged();
+    emit maxConnectionsChanged(maxConnections);
+}
+
+int QHttpServer::maxConnections() const
+{
+    return d->settings.maxConnections;
+}
+
+void QHttpServer::setMaxConnectionsPerThread(int maxConnectionsPerThread)
+{
+    if (d->settings.maxConnectionsPerThread == maxConnectionsPerThread) return;
+    d->settings.maxConnectionsPerThread = maxConnectionsPerThread;
+    emit maxConnectionsPerThreadChanged(maxConnectionsPerThread);
+}
+
+int QHttpServer::maxConnectionsPerThread() const
+{
+    return d->settings.maxConnectionsPerThread;
+}
+
+void QHttpServer::setMaxInFlightRequests(int maxInFlightRequests)
+{
+    if (d->settings.maxInFlightRequests == maxInFlightRequests) return;
+    d->settings.maxInFlightRequests = maxInFlightRequests;
+    emit maxInFlightRequestsChanged(maxInFlightRequests);
+}
+
+int QHttpServer::maxInFlightRequests() const
+{
+    return d->settings.maxInFlightRequests;
+}
+
+void QHttpServer::setMaxInFlightRequestsPerThread(int maxInFlightRequestsPerThread)
+{
+    if (d->settings.maxInFlightRequestsPerThread == maxInFlightRequestsPerThread) return;
+    d->settings.maxInFlightRequestsPerThread = maxInFlightRequestsPerThread;
+    emit maxInFlightRequestsPerThreadChanged(maxInFlightRequestsPerThread);
+}
+
+int QHttpServer::maxInFlightRequestsPerThread() const
+{
+    return d->settings.maxInFlightRequestsPerThread;
+}
+
+void QHttpServer::setRetryAfter(int retryAfter)
+{
+    if (d->settings.retryAfter == retryAfter) return;
+    d->settings.retryAfter = retryAfter;
+    emit retryAfterChanged(retryAfter);
+}
+
+int QHttpServer::retryAfter() const
+{
+    return d->settings.retryAfter;
+}
+
+void QHttpServer::setOverloadPolicy(OverloadPolicy overloadPolicy)
+{
+    if (d->settings.overloadPolicy == overloadPolicy) return;
+    d->settings.overloadPolicy = overloadPolicy;
+    d->settings.admission->limitsChanged();
+    emit overloadPolicyChanged(overloadPolicy);
+}
+
+QHttpServer::OverloadPolicy QHttpServer::overloadPolicy() const
+{
+    return d->settings.overloadPolicy;
+}
+
+int QHttpServer::connectionCount() const
+{
+    return d->settings.admission->connections();
+}
+
+int QHttpServer::inFlightRequestCount() const
+{
+    return d->settings.admission->requests();
+}
+
+quint64 QHttpServer::shedConnections() const
+{
+    return d->settings.admission->shedConnections();
+}
+
+quint64 QHttpServer::shedRequests() const
+{
+    return d->settings.admission->shedRequests();
+}
+
+void QHttpServer::setSequentialRequestIds(bool sequentialRequestIds)
+{
+    if (d->settings.sequentialRequestIds == sequentialRequestIds) return;
+    d->settings.sequentialRequestIds = sequentialRequestIds;
+    emit sequentialRequestIdsChanged(sequentialRequestIds);
+}
+
+bool QHttpServer::sequentialRequestIds() const
+{
+    return d->settings.sequentialRequestIds;
+}
+
+void QHttpServer::setCompressionMinimumSize(qint64 compressionMinimumSize)
+{
+    if (d->settings.compressionMinimumSize == compressionMinimumSize) return;
+    d->settings.compressionMinimumSize = compressionMinimumSize;
+    emit compressionMinimumSizeChanged(compressionMinimumSize);
+}
+
+qint64 QHttpServer::compressionMinimumSize() const
+{
+    return d->settings.compressionMinimumSize;
+}
+
+static QList<QByteArray> mimeTypePatterns(const QStringList &mimeTypes)
+{
+    QList<QByteArray> ret;
+    foreach (const QString &mimeType, mimeTypes) {
+        ret.append(mimeType.trimmed().toLower().toLatin1());
+    }
+    return ret;
+}
+
+static QStringList mimeTypeList(const QList<QByteArray> &patterns)
+{
+    QStringList ret;
+    foreach (const QByteArray &pattern, patterns) {
+        ret.append(QString::fromLatin1(pattern));
+    }
+    return ret;
+}
+
+void QHttpServer::setCompressionMimeTypes(const QStringList &compressionMimeTypes)
+{
+    // the worker threads read the list without a lock
+    if (isListening()) {
+        qhsWarning() << "compression MIME types can not be changed while listening.";
+        return;
+    }
+    QList<QByteArray> patterns = mimeTypePatterns(compressionMimeTypes);
+    if (d->settings.compressionMimeTypes == patterns) return;
+    d->settings.compressionMimeTypes = patterns;
+    emit compressionMimeTypesChanged(compressionMimeTypes);
+}
+
+QStringList QHttpServer::compressionMimeTypes() const
+{
+    return mimeTypeList(d->settings.compressionMimeTypes);
+}
+
+void QHttpServer::setCompressionExcludedMimeTypes(const QStringList &compressionExcludedMimeTypes)
+{
+    // the worker threads read the list without a lock
+    if (isListening()) {
+        qhsWarning() << "excluded compression MIME types can not be changed while listening.";
+        return;
+    }
+    QList<QByteArray> patterns = mimeTypePatterns(compressionExcludedMimeTypes);
+    if (d->settings.compressionExcludedMimeTypes == patterns) return;
+    d->settings.compressionExcludedMimeTypes = patterns;
+    emit compressionExcludedMimeTypesChanged(compressionExcludedMimeTypes);
+}
+
+QStringList QHttpServer::compressionExcludedMimeTypes() const
+{
+    return mimeTypeList(d->settings.compressionExcludedMimeTypes);
+}
+
+void QHttpServer::setCompressionCacheSize(qint64 compressionCacheSize)
+{
+    if (d->settings.compressionCache.maxSize() == compressionCacheSize) return;
+    d->settings.compressionCache.setMaxSize(compressionCacheSize);
+    emit compressionCacheSizeChanged(compressionCacheSize);
+}
+
+qint64 QHttpServer::compressionCacheSize() const
+{
+    return d->settings.compressionCache.maxSize();
+}
+
+quint64 QHttpServer::compressionCacheHits() const
+{
+    return d->settings.compressionCache.hits();
+}
+
+quint64 QHttpServer::compressionCacheMisses() const
+{
+    return d->settings.compressionCache.misses();
+}
+
+void QHttpServer::setContentEncoder(const QByteArray &encoding, const ContentEncoderFactory &factory)
+{
+    // the worker threads pick encoders from the list without a lock
+    if (isListening()) {
+        qhsWarning() << "content encoders can not be changed while listening.";
+        return;
+    }
+    QByteArray name = encoding.trimmed().toLower();
+    for (int i = 0; i < d->settings.contentEncoders.length(); i++) {
+        if (d->settings.contentEncoders.at(i).first == name) {
+            d->settings.contentEncoders.removeAt(i);
+            break;
+        }
+    }
+    if (factory)
+        d->settings.contentEncoders.prepend(qMakePair(name, factory));
+}
+
+QList<QByteArray> QHttpServer::contentEncodings() const
+{
+    QList<QByteArray> ret;
+    for (int i = 0; i < d->settings.contentEncoders.length(); i++) {
+        ret.append(d->settings.contentEncoders.at(i).first);
+    }
+    return ret;
+}
+
 quint16 QHttpServer::serverPort() const
 {
+    if (d->reusePortListening)
+        return d->reusePortPort;
     return d->serverPort();
 }
 
 QHostAddress QHttpServer::serverAddress() const
 {
+    if (d->reusePortListening)
+        return d->reusePortAddress;
     return d->serverAddress();
 }
 
 QAbstractSocket::SocketError QHttpServer::serverError() const
 {
+    if (!d->reusePortErrorString.isEmpty())
+        return d->reusePortError;
     return d->serverError();
 }
 
 QString QHttpServer::errorString() const
 {
+    if (!d->reusePortErrorString.isEmpty())
+        return d->reusePortErrorString;
     return d->errorString();
 }
 
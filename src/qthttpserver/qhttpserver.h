@@ -28,13 +28,19 @@
 #define QHTTPSERVER_H
 
 #include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
 #include <QtNetwork/QHostAddress>
 
+#include <functional>
+
 #include "qthttpserverglobal.h"
 
 class QHttpRequest;
 class QHttpReply;
 class QWebSocket;
+class QIODevice;
+class QHttpContentEncoder;
 
 QT_BEGIN_NAMESPACE
 
@@ -42,8 +48,53 @@ class Q_HTTPSERVER_EXPORT QHttpServer : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(int maxPendingConnections READ maxPendingConnections WRITE setMaxPendingConnections NOTIFY maxPendingConnectionsChanged)
+    Q_PROPERTY(int workerCount READ workerCount WRITE setWorkerCount NOTIFY workerCountChanged)
+    Q_PROPERTY(DispatchPolicy dispatchPolicy READ dispatchPolicy WRITE setDispatchPolicy NOTIFY dispatchPolicyChanged)
+    Q_PROPERTY(bool reusePort READ reusePort WRITE setReusePort NOTIFY reusePortChanged)
+    Q_PROPERTY(qint64 uploadMemoryThreshold READ uploadMemoryThreshold WRITE setUploadMemoryThreshold NOTIFY uploadMemoryThresholdChanged)
+    Q_PROPERTY(bool streamRequestBodies READ streamRequestBodies WRITE setStreamRequestBodies NOTIFY streamRequestBodiesChanged)
+    Q_PROPERTY(int maxRequestsPerConnection READ maxRequestsPerConnection WRITE setMaxRequestsPerConnection NOTIFY maxRequestsPerConnectionChanged)
+    Q_PROPERTY(int keepAliveTimeout READ keepAliveTimeout WRITE setKeepAliveTimeout NOTIFY keepAliveTimeoutChanged)
+    Q_PROPERTY(int headerTimeout READ headerTimeout WRITE setHeaderTimeout NOTIFY headerTimeoutChanged)
+    Q_PROPERTY(int bodyTimeout READ bodyTimeout WRITE setBodyTimeout NOTIFY bodyTimeoutChanged)
+    Q_PROPERTY(int writeTimeout READ writeTimeout WRITE setWriteTimeout NOTIFY writeTimeoutChanged)
+    Q_PROPERTY(int maxRequestLineLength READ maxRequestLineLength WRITE setMaxRequestLineLength NOTIFY maxRequestLineLengthChanged)
+    Q_PROPERTY(int maxHeaderSize READ maxHeaderSize WRITE setMaxHeaderSize NOTIFY maxHeaderSizeChanged)
+    Q_PROPERTY(int maxHeaderCount READ maxHeaderCount WRITE setMaxHeaderCount NOTIFY maxHeaderCountChanged)
+    Q_PROPERTY(qint64 maxBodySize READ maxBodySize WRITE setMaxBodySize NOTIFY maxBodySizeChanged)
+    Q_PROPERTY(int readBufferSize READ readBufferSize WRITE setReadBufferSize NOTIFY readBufferSizeChanged)
+    Q_PROPERTY(int maxConnections READ maxConnections WRITE setMaxConnections NOTIFY maxConnectionsChanged)
+    Q_PROPERTY(int maxConnectionsPerThread READ maxConnectionsPerThread WRITE setMaxConnectionsPerThread NOTIFY maxConnectionsPerThreadChanged)
+    Q_PROPERTY(int maxInFlightRequests READ maxInFlightRequests WRITE setMaxInFlightRequests NOTIFY maxInFlightRequestsChanged)
+    Q_PROPERTY(int maxInFlightRequestsPerThread READ maxInFlightRequestsPerThread WRITE setMaxInFlightRequestsPerThread NOTIFY maxInFlightRequestsPerThreadChanged)
+    Q_PROPERTY(int retryAfter READ retryAfter WRITE setRetryAfter NOTIFY retryAfterChanged)
+    Q_PROPERTY(OverloadPolicy overloadPolicy READ overloadPolicy WRITE setOverloadPolicy NOTIFY overloadPolicyChanged)
+    Q_PROPERTY(bool sequentialRequestIds READ sequentialRequestIds WRITE setSequentialRequestIds NOTIFY sequentialRequestIdsChanged)
+    Q_PROPERTY(qint64 compressionMinimumSize READ compressionMinimumSize WRITE setCompressionMinimumSize NOTIFY compressionMinimumSizeChanged)
+    Q_PROPERTY(QStringList compressionMimeTypes READ compressionMimeTypes WRITE setCompressionMimeTypes NOTIFY compressionMimeTypesChanged)
+    Q_PROPERTY(QStringList compressionExcludedMimeTypes READ compressionExcludedMimeTypes WRITE setCompressionExcludedMimeTypes NOTIFY compressionExcludedMimeTypesChanged)
+    Q_PROPERTY(qint64 compressionCacheSize READ compressionCacheSize WRITE setCompressionCacheSize NOTIFY compressionCacheSizeChanged)
 public:
+    enum DispatchPolicy {
+        RoundRobin
+        , LeastLoaded
+    };
+    Q_ENUM(DispatchPolicy)
+
+    enum OverloadPolicy {
+        RejectConnections
+        , PauseAccepting
+    };
+    Q_ENUM(OverloadPolicy)
+
+    // returns the device an uploaded file is written to, or 0 for the default behaviour.
+    // called on the connection's thread, devices without a parent are owned by the QHttpFileData
+    typedef std::function<QIODevice *(QHttpRequest *request, const QHash<QByteArray, QByteArray> &rawHeaders)> UploadDeviceFactory;
+    // returns a new encoder, it is deleted by the reply. called on the connection's thread
+    typedef std::function<QHttpContentEncoder *()> ContentEncoderFactory;
+
     explicit QHttpServer(QObject *parent = Q_NULLPTR);
+    ~QHttpServer();
 
     bool listen(const QHostAddress &address = QHostAddress::Any, quint16 port = 0);
     void close();
@@ -53,6 +104,129 @@ public:
     void setMaxPendingConnections(int maxPendingConnections);
     int maxPendingConnections() const;
 
+    // connections are handled on the server thread when workerCount is 0
+    void setWorkerCount(int workerCount);
+    int workerCount() const;
+
+    void setDispatchPolicy(DispatchPolicy dispatchPolicy);
+    DispatchPolicy dispatchPolicy() const;
+
+    // with workers, listen() opens one SO_REUSEPORT socket per worker thread
+    void setReusePort(bool reusePort);
+    bool reusePort() const;
+
+    // uploaded files larger than this are written to temporary files
+    void setUploadMemoryThreshold(qint64 uploadMemoryThreshold);
+    qint64 uploadMemoryThreshold() const;
+
+    void setUploadDeviceFactory(const UploadDeviceFactory &uploadDeviceFactory);
+
+    // requests with a body are handed out after the headers, see QHttpRequest::isStreaming()
+    void setStreamRequestBodies(bool streamRequestBodies);
+    bool streamRequestBodies() const;
+
+    // the reply to the last request allowed on a connection closes it, 0 allows any number
+    void setMaxRequestsPerConnection(int maxRequestsPerConnection);
+    int maxRequestsPerConnection() const;
+
+    // msecs a persistent connection may wait for its next request, also the time a new
+    // connection has to start sending. 0 closes every connection after one reply
+    void setKeepAliveTimeout(int keepAliveTimeout);
+    int keepAliveTimeout() const;
+
+    // msecs a client has to send the request line and headers in, counted from their first
+    // byte, and msecs a request body may go without data. a request that is not complete in
+    // time gets 408 Request Timeout and the connection is closed. 0 disables a timeout
+    void setHeaderTimeout(int headerTimeout);
+    int headerTimeout() const;
+    void setBodyTimeout(int bodyTimeout);
+    int bodyTimeout() const;
+
+    // msecs output may wait in a connection without the client taking any of it before
+    // the connection is aborted, 0 disables it
+    void setWriteTimeout(int writeTimeout);
+    int writeTimeout() const;
+
+    // requests over these limits are answered with 414 URI Too Long, 431 Request Header Fields
+    // Too Large or 413 Payload Too Large before they are handed out and the connection is
+    // closed. maxHeaderSize counts the request line and all headers. 0 is no limit
+    void setMaxRequestLineLength(int maxRequestLineLength);
+    int maxRequestLineLength() const;
+    void setMaxHeaderSize(int maxHeaderSize);
+    int maxHeaderSize() const;
+    void setMaxHeaderCount(int maxHeaderCount);
+    int maxHeaderCount() const;
+    // bodies are limited to 8 MiB by default, bigger uploads need a higher limit or 0
+    void setMaxBodySize(qint64 maxBodySize);
+    qint64 maxBodySize() const;
+
+    // bytes a connection reads from the socket ahead of the request being handled,
+    // clients sending more are throttled by TCP. 0 reads whatever arrives
+    void setReadBufferSize(int readBufferSize);
+    int readBufferSize() const;
+
+    // connections over the limits get 503 Service Unavailable and are closed right after
+    // they are accepted. the 503 is best-effort: a request arriving after the close makes
+    // the kernel reset the connection, and the client may never read the response.
+    // with workers a connection goes to the next worker when one is at
+    // maxConnectionsPerThread. 0 is no limit
+    void setMaxConnections(int maxConnections);
+    int maxConnections() const;
+    void setMaxConnectionsPerThread(int maxConnectionsPerThread);
+    int maxConnectionsPerThread() const;
+
+    // requests are in flight from their head until their reply is finished, those over
+    // the limits are answered with 503 Service Unavailable and not handed out. 0 is no limit
+    void setMaxInFlightRequests(int maxInFlightRequests);
+    int maxInFlightRequests() const;
+    void setMaxInFlightRequestsPerThread(int maxInFlightRequestsPerThread);
+    int maxInFlightRequestsPerThread() const;
+
+    // seconds sent as Retry-After with 503 Service Unavailable, 0 omits the header
+    void setRetryAfter(int retryAfter);
+    int retryAfter() const;
+
+    // with PauseAccepting nothing is accepted while maxConnections are open, new
+    // connections wait in the listen backlog instead of being refused
+    void setOverloadPolicy(OverloadPolicy overloadPolicy);
+    OverloadPolicy overloadPolicy() const;
+
+    int connectionCount() const;
+    int inFlightRequestCount() const;
+    // connections and requests refused because of the limits
+    quint64 shedConnections() const;
+    quint64 shedRequests() const;
+
+    // uuid() of requests and web sockets is a random prefix chosen once per process followed by
+    // a counter instead of a random uuid. cheaper, unique within the process and increasing
+    void setSequentialRequestIds(bool sequentialRequestIds);
+    bool sequentialRequestIds() const;
+
+    // replies smaller than this are sent uncompressed, streamed replies are not checked
+    void setCompressionMinimumSize(qint64 compressionMinimumSize);
+    qint64 compressionMinimumSize() const;
+
+    // Content-Types that are compressed, "type/*" matches a whole type and an empty list
+    // allows every type. excluded types win over the allowed ones. the lists can only be
+    // set before listen(), later calls are ignored with a warning
+    void setCompressionMimeTypes(const QStringList &compressionMimeTypes);
+    QStringList compressionMimeTypes() const;
+    void setCompressionExcludedMimeTypes(const QStringList &compressionExcludedMimeTypes);
+    QStringList compressionExcludedMimeTypes() const;
+
+    // bytes of compressed reply bodies kept to answer identical replies without compressing
+    // them again, 0 disables the cache. streamed replies are not cached
+    void setCompressionCacheSize(qint64 compressionCacheSize);
+    qint64 compressionCacheSize() const;
+    quint64 compressionCacheHits() const;
+    quint64 compressionCacheMisses() const;
+
+    // adds or replaces the encoder for a content-coding such as "br", an empty factory
+    // removes it. added encoders are preferred when a client accepts several codings equally.
+    // encoders can only be changed before listen(), later calls are ignored with a warning
+    void setContentEncoder(const QByteArray &encoding, const ContentEncoderFactory &factory);
+    QList<QByteArray> contentEncodings() const;
+
     quint16 serverPort() const;
     QHostAddress serverAddress() const;
 
@@ -61,6 +235,35 @@ public:
 
 Q_SIGNALS:
     void maxPendingConnectionsChanged(int maxPendingConnections);
+    void workerCountChanged(int workerCount);
+    void dispatchPolicyChanged(DispatchPolicy dispatchPolicy);
+    void reusePortChanged(bool reusePort);
+    void uploadMemoryThresholdChanged(qint64 uploadMemoryThreshold);
+    void streamRequestBodiesChanged(bool streamRequestBodies);
+    void maxRequestsPerConnectionChanged(int maxRequestsPerConnection);
+    void keepAliveTimeoutChanged(int keepAliveTimeout);
+    void headerTimeoutChanged(int headerTimeout);
+    void bodyTimeoutChanged(int bodyTimeout);
+    void writeTimeoutChanged(int writeTimeout);
+    void maxRequestLineLengthChanged(int maxRequestLineLength);
+    void maxHeaderSizeChanged(int maxHeaderSize);
+    void maxHeaderCountChanged(int maxHeaderCount);
+    void maxBodySizeChanged(qint64 maxBodySize);
+    void readBufferSizeChanged(int readBufferSize);
+    void maxConnectionsChanged(int maxConnections);
+    void maxConnectionsPerThreadChanged(int maxConnectionsPerThread);
+    void maxInFlightRequestsChanged(int maxInFlightRequests);
+    void maxInFlightRequestsPerThreadChanged(int maxInFlightRequestsPerThread);
+    void retryAfterChanged(int retryAfter);
+    void overloadPolicyChanged(OverloadPolicy overloadPolicy);
+    void sequentialRequestIdsChanged(bool sequentialRequestIds);
+    void compressionMinimumSizeChanged(qint64 compressionMinimumSize);
+    void compressionMimeTypesChanged(const QStringList &compressionMimeTypes);
+    void compressionExcludedMimeTypesChanged(const QStringList &compressionExcludedMimeTypes);
+    void compressionCacheSizeChanged(qint64 compressionCacheSize);
+
+    // emitted on the thread that handles the connection, use Qt::DirectConnection
+    // to process requests on worker threads
 
     void incomingConnection(QHttpRequest *request, QHttpReply *reply);
     void incomingConnection(QWebSocket *socket);
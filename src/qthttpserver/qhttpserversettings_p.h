@@ -0,0 +1,147 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPSERVERSETTINGS_H
+#define QHTTPSERVERSETTINGS_H
+
+#include "qhttpserver.h"
+#include "qhttpcompressor_p.h"
+
+#include <QtCore/QPair>
+
+class QHttpAdmission;
+
+// server wide settings, connections keep a pointer to them and read them from
+// the worker threads, so they should be changed before listen()
+class QHttpServerSettings
+{
+public:
+    QHttpServerSettings();
+
+    qint64 uploadMemoryThreshold;
+    QHttpServer::UploadDeviceFactory uploadDeviceFactory;
+    bool streamRequestBodies;
+    int maxRequestsPerConnection;
+    int keepAliveTimeout;
+    int headerTimeout;
+    int bodyTimeout;
+    int writeTimeout;
+    bool sequentialRequestIds;
+    // 0 is no limit
+    int maxRequestLineLength;
+    int maxHeaderSize;
+    int maxHeaderCount;
+    qint64 maxBodySize;
+    int maxConnections;
+    int maxConnectionsPerThread;
+    int maxInFlightRequests;
+    int maxInFlightRequestsPerThread;
+    // seconds, sent with 503 Service Unavailable when a limit is reached
+    int retryAfter;
+    QHttpServer::OverloadPolicy overloadPolicy;
+    // bytes the socket reads ahead of the requests, 0 is unbounded
+    int readBufferSize;
+    // counts connections and requests against the limits, set by the server
+    QHttpAdmission *admission;
+    qint64 compressionMinimumSize;
+    // lower case patterns, see QHttpServer::setCompressionMimeTypes()
+    QList<QByteArray> compressionMimeTypes;
+    QList<QByteArray> compressionExcludedMimeTypes;
+    // locks itself, it is used by the connections on every thread
+    mutable QHttpCompressionCache compressionCache;
+    // the encoders in order of preference when a client accepts several of them equally
+    QList<QPair<QByteArray, QHttpServer::ContentEncoderFactory> > contentEncoders;
+
+    bool isCompressible(const QByteArray &contentType, qint64 size) const;
+};
+
+inline QHttpServerSettings::QHttpServerSettings()
+    : uploadMemoryThreshold(1024 * 1024)
+    , streamRequestBodies(false)
+    , maxRequestsPerConnection(1000)
+    , keepAliveTimeout(5000)
+    , headerTimeout(10000)
+    , bodyTimeout(30000)
+    , writeTimeout(30000)
+    , sequentialRequestIds(false)
+    , maxRequestLineLength(8 * 1024)
+    , maxHeaderSize(32 * 1024)
+    , maxHeaderCount(100)
+    , maxBodySize(8 * 1024 * 1024)
+    , maxConnections(0)
+    , maxConnectionsPerThread(0)
+    , maxInFlightRequests(0)
+    , maxInFlightRequestsPerThread(0)
+    , retryAfter(1)
+    , overloadPolicy(QHttpServer::RejectConnections)
+    , readBufferSize(64 * 1024)
+    , admission(0)
+    , compressionMinimumSize(1024)
+{
+    compressionMimeTypes << "text/*"
+                         << "application/json"
+                         << "application/javascript"
+                         << "application/xml"
+                         << "application/xhtml+xml"
+                         << "image/svg+xml";
+
+#ifdef QHS_HAVE_BROTLI
+    contentEncoders.append(qMakePair(QByteArray("br"), QHttpServer::ContentEncoderFactory([]() -> QHttpContentEncoder * { return new QHttpBrotliEncoder; })));
+#endif
+#ifdef QHS_HAVE_ZSTD
+    contentEncoders.append(qMakePair(QByteArray("zstd"), QHttpServer::ContentEncoderFactory([]() -> QHttpContentEncoder * { return new QHttpZstdEncoder; })));
+#endif
+    contentEncoders.append(qMakePair(QByteArray("gzip"), QHttpServer::ContentEncoderFactory([]() -> QHttpContentEncoder * { return new QHttpCompressor(QHttpCompressor::Gzip); })));
+    contentEncoders.append(qMakePair(QByteArray("deflate"), QHttpServer::ContentEncoderFactory([]() -> QHttpContentEncoder * { return new QHttpCompressor(QHttpCompressor::Deflate); })));
+}
+
+// size is -1 when it is not known yet
+inline bool QHttpServerSettings::isCompressible(const QByteArray &contentType, qint64 size) const
+{
+    if (size >= 0 && size < compressionMinimumSize)
+        return false;
+
+    QByteArray mimeType = contentType;
+    int semicolon = mimeType.indexOf(';');
+    if (semicolon >= 0)
+        mimeType.truncate(semicolon);
+    mimeType = mimeType.trimmed().toLower();
+
+    foreach (const QByteArray &pattern, compressionExcludedMimeTypes) {
+        if (pattern.endsWith("/*") ? mimeType.startsWith(pattern.left(pattern.length() - 1)) : mimeType == pattern)
+            return false;
+    }
+    if (compressionMimeTypes.isEmpty())
+        return true;
+    foreach (const QByteArray &pattern, compressionMimeTypes) {
+        if (pattern.endsWith("/*") ? mimeType.startsWith(pattern.left(pattern.length() - 1)) : mimeType == pattern)
+            return true;
+    }
+    return false;
+}
+
+#endif // QHTTPSERVERSETTINGS_H
@@ -0,0 +1,190 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "qhttptimerwheel_p.h"
+
+#include <QtCore/QThreadStorage>
+#include <QtCore/QTimerEvent>
+
+QHttpTimeout::QHttpTimeout(QObject *receiver, const char *member)
+    : receiver(receiver)
+    , member(member)
+    , wheel(0)
+    , prev(0)
+    , next(0)
+    , bucket(0)
+    , rounds(0)
+{
+}
+
+QHttpTimeout::~QHttpTimeout()
+{
+    stop();
+}
+
+bool QHttpTimeout::isActive() const
+{
+    return wheel != 0;
+}
+
+void QHttpTimeout::start(int msecs)
+{
+    stop();
+    QHttpTimerWheel::instance()->insert(this, msecs);
+}
+
+void QHttpTimeout::stop()
+{
+    if (wheel)
+        wheel->remove(this);
+}
+
+static QThreadStorage<QHttpTimerWheel *> timerWheels;
+
+QHttpTimerWheel *QHttpTimerWheel::instance()
+{
+    if (!timerWheels.hasLocalData())
+        timerWheels.setLocalData(new QHttpTimerWheel);
+    return timerWheels.localData();
+}
+
+QHttpTimerWheel::QHttpTimerWheel()
+    : expired(0)
+    , current(0)
+    , count(0)
+    , ticks(0)
+{
+    for (int i = 0; i < bucketCount; i++)
+        buckets[i] = 0;
+    clock.start();
+}
+
+QHttpTimerWheel::~QHttpTimerWheel()
+{
+    // the timeouts outlive the wheel at thread exit, they only have to forget it
+    for (int i = -1; i < bucketCount; i++) {
+        for (QHttpTimeout *timeout = *head(i); timeout; timeout = timeout->next)
+            timeout->wheel = 0;
+    }
+}
+
+// bucket -1 is the list of expired timeouts
+QHttpTimeout **QHttpTimerWheel::head(int bucket)
+{
+    return bucket < 0 ? &expired : &buckets[bucket];
+}
+
+void QHttpTimerWheel::insert(QHttpTimeout *timeout, int msecs)
+{
+    if (count++ == 0) {
+        // nothing has been due while the wheel stood still
+        ticks = clock.elapsed() / tick;
+        timer.start(tick, this);
+    } else {
+        // the bucket is counted from now, not from the last tick the event loop got to
+        catchUp();
+    }
+    int due = qMax(1, (msecs + tick - 1) / tick);
+    timeout->wheel = this;
+    timeout->bucket = (current + due) % bucketCount;
+    timeout->rounds = (due - 1) / bucketCount;
+    timeout->prev = 0;
+    timeout->next = buckets[timeout->bucket];
+    if (timeout->next)
+        timeout->next->prev = timeout;
+    buckets[timeout->bucket] = timeout;
+}
+
+void QHttpTimerWheel::remove(QHttpTimeout *timeout)
+{
+    if (timeout->prev)
+        timeout->prev->next = timeout->next;
+    else
+        *head(timeout->bucket) = timeout->next;
+    if (timeout->next)
+        timeout->next->prev = timeout->prev;
+    timeout->wheel = 0;
+    timeout->prev = 0;
+    timeout->next = 0;
+    if (--count == 0)
+        timer.stop();
+}
+
+// moves the timeouts of the next bucket that are due to the expired list
+void QHttpTimerWheel::advance()
+{
+    current = (current + 1) % bucketCount;
+    QHttpTimeout *timeout = buckets[current];
+    while (timeout) {
+        QHttpTimeout *next = timeout->next;
+        if (timeout->rounds > 0) {
+            timeout->rounds--;
+        } else {
+            if (timeout->prev)
+                timeout->prev->next = next;
+            else
+                buckets[current] = next;
+            if (next)
+                next->prev = timeout->prev;
+            timeout->bucket = -1;
+            timeout->prev = 0;
+            timeout->next = expired;
+            if (expired)
+                expired->prev = timeout;
+            expired = timeout;
+        }
+        timeout = next;
+    }
+}
+
+// advances over the ticks the event loop was too busy for
+void QHttpTimerWheel::catchUp()
+{
+    qint64 now = clock.elapsed() / tick;
+    while (ticks < now) {
+        advance();
+        ticks++;
+    }
+}
+
+void QHttpTimerWheel::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+    catchUp();
+    // a receiver may start or stop any timeout, including expired ones
+    while (expired) {
+        QHttpTimeout *timeout = expired;
+        QObject *receiver = timeout->receiver;
+        const char *member = timeout->member;
+        remove(timeout);
+        QMetaObject::invokeMethod(receiver, member, Qt::DirectConnection);
+    }
+}
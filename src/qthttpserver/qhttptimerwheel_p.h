@@ -0,0 +1,97 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPTIMERWHEEL_H
+#define QHTTPTIMERWHEEL_H
+
+#include <QtCore/QBasicTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QObject>
+
+class QHttpTimerWheel;
+
+// a timeout on the timer wheel of the thread it is started on. starting, restarting and
+// stopping it take constant time, so connections can re-arm theirs on every read.
+// member of receiver is invoked by name when it expires
+class QHttpTimeout
+{
+public:
+    QHttpTimeout(QObject *receiver, const char *member);
+    ~QHttpTimeout();
+
+    bool isActive() const;
+    // msecs are rounded up to whole ticks of the wheel
+    void start(int msecs);
+    void stop();
+
+private:
+    friend class QHttpTimerWheel;
+    QObject *receiver;
+    const char *member;
+    QHttpTimerWheel *wheel;
+    QHttpTimeout *prev;
+    QHttpTimeout *next;
+    int bucket;
+    int rounds;
+    Q_DISABLE_COPY(QHttpTimeout)
+};
+
+// hashed timer wheel, one per thread. a single timer ticks while any timeout is active
+class QHttpTimerWheel : public QObject
+{
+public:
+    static QHttpTimerWheel *instance();
+    ~QHttpTimerWheel();
+
+    static const int tick = 100;
+    static const int bucketCount = 512;
+
+    void insert(QHttpTimeout *timeout, int msecs);
+    void remove(QHttpTimeout *timeout);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    QHttpTimerWheel();
+    void advance();
+    void catchUp();
+    QHttpTimeout **head(int bucket);
+
+    // the timeouts of a bucket expire when current gets there with rounds at 0
+    QHttpTimeout *buckets[bucketCount];
+    // timeouts waiting for their member to be invoked
+    QHttpTimeout *expired;
+    int current;
+    int count;
+    qint64 ticks;
+    QElapsedTimer clock;
+    QBasicTimer timer;
+    Q_DISABLE_COPY(QHttpTimerWheel)
+};
+
+#endif // QHTTPTIMERWHEEL_H
@@ -0,0 +1,213 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "qhttpworker_p.h"
+
+#include <QtCore/QThread>
+
+#include "qhttpserver.h"
+#include "qhttpconnection_p.h"
+#include "qhttpserversettings_p.h"
+
+#if defined(Q_OS_UNIX)
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+QHttpListener::QHttpListener(QHttpWorker *worker)
+    : QTcpServer(worker)
+    , worker(worker)
+{
+    connect(worker->settings->admission, SIGNAL(fullChanged()), this, SLOT(updateAccepting()));
+}
+
+bool QHttpListener::isReusePortSupported()
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// opens a listening socket which shares address and port with the other workers' sockets,
+// the kernel then balances new connections between them. *port is updated when it is 0.
+qintptr QHttpListener::openReusePortSocket(const QHostAddress &address, quint16 *port, QAbstractSocket::SocketError *error, QString *errorString)
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    sockaddr_storage storage;
+    memset(&storage, 0, sizeof(storage));
+    socklen_t length = 0;
+    int family = AF_INET6;
+
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        family = AF_INET;
+        sockaddr_in *sin = reinterpret_cast<sockaddr_in *>(&storage);
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(*port);
+        sin->sin_addr.s_addr = htonl(address.toIPv4Address());
+        length = sizeof(sockaddr_in);
+    } else {
+        sockaddr_in6 *sin6 = reinterpret_cast<sockaddr_in6 *>(&storage);
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(*port);
+        Q_IPV6ADDR ip6 = address.toIPv6Address();
+        memcpy(&sin6->sin6_addr, &ip6, sizeof(ip6));
+        length = sizeof(sockaddr_in6);
+    }
+
+    int fd = ::socket(family, SOCK_STREAM, 0);
+    if (fd == -1) {
+        *error = QAbstractSocket::UnsupportedSocketOperationError;
+        *errorString = QString::fromLocal8Bit(strerror(errno));
+        return -1;
+    }
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    int on = 1;
+    int off = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (family == AF_INET6) {
+        // QHostAddress::Any listens on both IPv4 and IPv6
+        int v6only = (address == QHostAddress::Any) ? off : on;
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+    }
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1
+            || ::bind(fd, reinterpret_cast<sockaddr *>(&storage), length) == -1
+            || ::listen(fd, SOMAXCONN) == -1) {
+        switch (errno) {
+        case EADDRINUSE:
+            *error = QAbstractSocket::AddressInUseError;
+            break;
+        case EACCES:
+            *error = QAbstractSocket::SocketAccessError;
+            break;
+        case EADDRNOTAVAIL:
+            *error = QAbstractSocket::SocketAddressNotAvailableError;
+            break;
+        default:
+            *error = QAbstractSocket::UnknownSocketError;
+            break;
+        }
+        *errorString = QString::fromLocal8Bit(strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+
+    if (*port == 0) {
+        length = sizeof(storage);
+        ::getsockname(fd, reinterpret_cast<sockaddr *>(&storage), &length);
+        if (storage.ss_family == AF_INET)
+            *port = ntohs(reinterpret_cast<sockaddr_in *>(&storage)->sin_port);
+        else
+            *port = ntohs(reinterpret_cast<sockaddr_in6 *>(&storage)->sin6_port);
+    }
+    return fd;
+#else
+    Q_UNUSED(address)
+    Q_UNUSED(port)
+    *error = QAbstractSocket::UnsupportedSocketOperationError;
+    *errorString = QStringLiteral("SO_REUSEPORT is not supported on this platform");
+    return -1;
+#endif
+}
+
+void QHttpListener::incomingConnection(qintptr socketDescriptor)
+{
+    if (!worker->admit()) {
+        worker->settings->admission->refuseConnection(socketDescriptor);
+        return;
+    }
+    worker->addConnection(socketDescriptor);
+}
+
+void QHttpListener::updateAccepting()
+{
+    worker->settings->admission->updateAccepting(this);
+}
+
+QHttpWorker::QHttpWorker(QHttpServer *server, const QHttpServerSettings *settings, QThread *thread)
+    : QObject()
+    , server(server)
+    , settings(settings)
+    , listener(0)
+{
+    moveToThread(thread);
+    connect(thread, SIGNAL(finished()), this, SLOT(deleteLater()));
+}
+
+QHttpWorker::~QHttpWorker()
+{
+    // connections release their place in threadLoad on deletion
+    qDeleteAll(findChildren<QHttpConnection *>(QString(), Qt::FindDirectChildrenOnly));
+}
+
+int QHttpWorker::load() const
+{
+    return threadLoad.connections.load();
+}
+
+bool QHttpWorker::admit()
+{
+    return settings->admission->admitConnection(&threadLoad);
+}
+
+// called on the accepting thread, the descriptor is adopted by the worker thread
+void QHttpWorker::dispatch(qintptr socketDescriptor)
+{
+    QMetaObject::invokeMethod(this, "addConnection", Qt::QueuedConnection, Q_ARG(qintptr, socketDescriptor));
+}
+
+bool QHttpWorker::listen(qintptr socketDescriptor)
+{
+    if (!listener)
+        listener = new QHttpListener(this);
+    if (listener->setSocketDescriptor(socketDescriptor))
+        return true;
+#if defined(Q_OS_UNIX)
+    ::close(socketDescriptor);
+#endif
+    return false;
+}
+
+void QHttpWorker::close()
+{
+    if (listener)
+        listener->close();
+}
+
+void QHttpWorker::addConnection(qintptr socketDescriptor)
+{
+    QHttpConnection *connection = new QHttpConnection(socketDescriptor, settings, &threadLoad, this);
+    // emitted directly so that handlers run on this thread
+    connect(connection, SIGNAL(ready(QHttpRequest *, QHttpReply *)), server, SIGNAL(incomingConnection(QHttpRequest *, QHttpReply *)), Qt::DirectConnection);
+    connect(connection, SIGNAL(ready(QWebSocket *)), server, SIGNAL(incomingConnection(QWebSocket *)), Qt::DirectConnection);
+}
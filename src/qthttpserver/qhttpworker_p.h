@@ -0,0 +1,86 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef QHTTPWORKER_H
+#define QHTTPWORKER_H
+
+#include <QtCore/QObject>
+#include <QtNetwork/QTcpServer>
+
+#include "qhttpadmission_p.h"
+
+class QThread;
+class QHttpServer;
+class QHttpServerSettings;
+class QHttpWorker;
+
+class QHttpListener : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit QHttpListener(QHttpWorker *worker);
+
+    static bool isReusePortSupported();
+    static qintptr openReusePortSocket(const QHostAddress &address, quint16 *port, QAbstractSocket::SocketError *error, QString *errorString);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor);
+
+private slots:
+    void updateAccepting();
+
+private:
+    QHttpWorker *worker;
+};
+
+class QHttpWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QHttpWorker(QHttpServer *server, const QHttpServerSettings *settings, QThread *thread);
+    ~QHttpWorker();
+
+    int load() const;
+    // reserves a connection on the server and the worker's thread for dispatch()
+    bool admit();
+    void dispatch(qintptr socketDescriptor);
+
+private slots:
+    bool listen(qintptr socketDescriptor);
+    void close();
+    void addConnection(qintptr socketDescriptor);
+
+private:
+    QHttpServer *server;
+    const QHttpServerSettings *settings;
+    QHttpListener *listener;
+    QHttpLoad threadLoad;
+    friend class QHttpListener;
+    Q_DISABLE_COPY(QHttpWorker)
+};
+
+#endif // QHTTPWORKER_H
@@ -7,7 +7,16 @@ SOURCES += \
     $$PWD/qabstractrequest.cpp \
     $$PWD/qhttprequest.cpp \
     $$PWD/qhttpconnection.cpp \
+    $$PWD/qhttpworker.cpp \
+    $$PWD/qhttpscan.cpp \
+    $$PWD/qhttpcompressor.cpp \
+    $$PWD/qhttpheaders.cpp \
+    $$PWD/qhttparena.cpp \
+    $$PWD/qhttptimerwheel.cpp \
+    $$PWD/qhttpadmission.cpp \
     $$PWD/qhttpreply.cpp \
+    $$PWD/qhttprouter.cpp \
+    $$PWD/qhttproutetree.cpp \
     $$PWD/qwebsocket.cpp \
     $$PWD/qhttpserver_logging.cpp
 
@@ -17,10 +26,32 @@ HEADERS += \
     $$PWD/qabstractrequest.h \
     $$PWD/qhttprequest.h \
     $$PWD/qhttpreply.h \
+    $$PWD/qhttprouter.h \
+    $$PWD/qhttpcontentencoder.h \
     $$PWD/qwebsocket.h \
     $$PWD/qhttpserver_logging.h
 
 PRIVATE_HEADERS = \
-    $$PWD/qhttpconnection_p.h
+    $$PWD/qhttpconnection_p.h \
+    $$PWD/qhttpworker_p.h \
+    $$PWD/qhttpscan_p.h \
+    $$PWD/qhttpserversettings_p.h \
+    $$PWD/qhttpcompressor_p.h \
+    $$PWD/qhttpheaders_p.h \
+    $$PWD/qhttparena_p.h \
+    $$PWD/qhttptimerwheel_p.h \
+    $$PWD/qhttpadmission_p.h \
+    $$PWD/qhttproutetree_p.h
 
 LIBS += -lz
+
+# optional Content-Encodings
+CONFIG += link_pkgconfig
+packagesExist(libbrotlienc) {
+    DEFINES += QHS_HAVE_BROTLI
+    PKGCONFIG += libbrotlienc
+}
+packagesExist(libzstd) {
+    DEFINES += QHS_HAVE_ZSTD
+    PKGCONFIG += libzstd
+}
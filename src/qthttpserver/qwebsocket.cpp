@@ -38,11 +38,7 @@ class QWebSocket::Private : public QObject
 {
     Q_OBJECT
 public:
-    enum ReadState {
-        ReadHeaders
-        , ReadDone
-    };
-    Private(QWebSocket *parent, const QUrl &url, const QHash<QByteArray, QByteArray> &rawHeaders);
+    Private(QWebSocket *parent, const QUrl &url);
     void accept(const QByteArray &protocol);
     void close();
     void send(const QByteArray &message);
@@ -62,70 +58,29 @@ private:
 
 public:
     QUrl url;
-    ReadState state;
     bool connected;
     QByteArray message;
 };
 
-QWebSocket::Private::Private(QWebSocket *parent, const QUrl &url, const QHash<QByteArray, QByteArray> &rawHeaders)
+QWebSocket::Private::Private(QWebSocket *parent, const QUrl &url)
     : QObject(parent)
     , q(parent)
     , draft(true)
     , version(17)
     , url(url)
-    , state(ReadHeaders)
     , connected(false)
 {
     this->url.setScheme(QLatin1String("ws"));
     connect(q->connection(), SIGNAL(readyRead()), this, SLOT(readyRead()));
     connect(q->connection(), SIGNAL(disconnected()), this, SLOT(disconnected()));
     connect(this, SIGNAL(destroyed()), q->connection(), SLOT(deleteLater()));
+    QMetaObject::invokeMethod(q, "ready", Qt::QueuedConnection);
 }
 
 void QWebSocket::Private::readyRead()
 {
-    QHttpConnection *connection = q->connection();
-    switch (state) {
-    case ReadHeaders:
-        while (connection->canReadLine()) {
-            QByteArray line = connection->readLine();
-            line = line.left(line.length() - 2);
-            if (line.isEmpty()) {
-                state = ReadDone;
-                emit q->ready();
-                break;
-            }
-
-            int space = line.indexOf(' ');
-            if (space > 0) {
-                QByteArray name = line.left(space - 1);
-                QByteArray value = line.mid(space + 1);
-                if (name == "Host") {
-                    int colon = value.indexOf(':');
-                    if (colon > -1) {
-                        url.setHost(QString::fromUtf8(value.left(colon)));
-                        url.setPort(value.mid(colon + 1).toUInt());
-                    } else {
-                        url.setHost(QString::fromUtf8(value));
-                        url.setPort(80);
-                    }
-                } else if (name == "Cookie") {
-                    foreach (const QByteArray &c, value.split(';')) {
-                        q->addCookie(QNetworkCookie::parseCookies(c));
-                    }
-                } else {
-                    q->insertRawHeader(name.toLower(), value);
-                }
-            }
-        }
-        break;
-    case ReadDone:
-        if (connected)
-            readData();
-        break;
-    default:
-        break;
-    }
+    if (connected)
+        readData();
 }
 
 void QWebSocket::Private::accept(const QByteArray &protocol)
@@ -157,7 +112,8 @@ void QWebSocket::Private::accept(const QByteArray &protocol)
 
         challenge.append(decode(key1));
         challenge.append(decode(key2));
-        QByteArray body = connection->read(8);
+        connection->fillBuffer();
+        QByteArray body = connection->takeBuffer(8);
         challenge.append(body);
         body = QCryptographicHash::hash(challenge, QCryptographicHash::Md5);
         connection->write(body);
@@ -210,7 +166,10 @@ QByteArray QWebSocket::Private::decode(const QByteArray &key) const
 void QWebSocket::Private::readData()
 {
     int pos = 0;
-    QByteArray data = q->connection()->readAll();
+    q->connection()->fillBuffer();
+    QByteArray data = q->connection()->takeBuffer();
+    if (data.isEmpty())
+        return;
 
     if (draft && version == 0 && (unsigned char)data.at(0) == 0x00 && (unsigned char)data.at(data.length() - 1) == 0xff) {
         data = data.mid(1, data.length() - 2);
@@ -335,11 +294,12 @@ void QWebSocket::Private::disconnected()
     q->deleteLater();
 }
 
-QWebSocket::QWebSocket(QHttpConnection *parent, const QUrl &url, const QHash<QByteArray, QByteArray> &rawHeaders)
+QWebSocket::QWebSocket(QHttpConnection *parent, const QUrl &url, QAbstractRequest *request)
     : QObject(parent)
     , QAbstractRequest(parent)
-    , d(new Private(this, url, rawHeaders))
+    , d(new Private(this, url))
 {
+    takeRawHeaders(request);
 }
 
 const QUrl &QWebSocket::url() const
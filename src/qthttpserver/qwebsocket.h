@@ -37,7 +37,8 @@ class Q_HTTPSERVER_EXPORT QWebSocket : public QObject, public QAbstractRequest
 {
     Q_OBJECT
 public:
-    explicit QWebSocket(QHttpConnection *parent, const QUrl &url, const QHash<QByteArray, QByteArray> &rawHeaders);
+    // takes over the headers and cookies of request
+    explicit QWebSocket(QHttpConnection *parent, const QUrl &url, QAbstractRequest *request);
     
     const QUrl &url() const;
 
@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = tst_doubleclose
+
+QT = core network httpserver testlib
+CONFIG += warn_on c++11 console testcase
+CONFIG -= app_bundle
+
+SOURCES = main.cpp
@@ -0,0 +1,121 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// a reply that is closed twice must only finish once. the connection keeps finished
+// replies for the next requests, a reply that finished twice was kept twice and two
+// pipelined requests then wrote into the same reply
+
+#include <QtCore/QList>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QtTest>
+
+#include <QtHttpServer/QHttpServer>
+#include <QtHttpServer/QHttpRequest>
+#include <QtHttpServer/QHttpReply>
+
+class tst_DoubleClose : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void closeTwice();
+
+private:
+    int parse(QTcpSocket *socket);
+
+    QHttpServer server;
+    int replies;
+    int done;
+    QList<QByteArray> bodies;
+    QByteArray received;
+};
+
+void tst_DoubleClose::initTestCase()
+{
+    replies = 0;
+    done = 0;
+    connect(&server, (void (QHttpServer:: *)(QHttpRequest *, QHttpReply *))&QHttpServer::incomingConnection
+            , [this](QHttpRequest *request, QHttpReply *reply) {
+                replies++;
+                connect(reply, &QHttpReply::done, [this]() { done++; });
+                reply->setRawHeader("Content-Type", "text/plain");
+                reply->write(request->target());
+                reply->close();
+                reply->close();
+            });
+    QVERIFY(server.listen(QHostAddress::LocalHost, 0));
+}
+
+// moves the complete responses received so far to bodies, every one of them has a
+// Content-Length
+int tst_DoubleClose::parse(QTcpSocket *socket)
+{
+    received += socket->readAll();
+    for (;;) {
+        int end = received.indexOf("\r\n\r\n");
+        if (end < 0)
+            break;
+        QByteArray head = received.left(end).toLower();
+        int field = head.indexOf("\r\ncontent-length:");
+        int length = 0;
+        if (field >= 0)
+            length = head.mid(field + 17, head.indexOf("\r\n", field + 17) - field - 17).trimmed().toInt();
+        if (received.length() < end + 4 + length)
+            break;
+        bodies.append(received.mid(end + 4, length));
+        received.remove(0, end + 4 + length);
+    }
+    return bodies.length();
+}
+
+void tst_DoubleClose::closeTwice()
+{
+    QTcpSocket socket;
+    socket.connectToHost(QHostAddress::LocalHost, server.serverPort());
+    QVERIFY(socket.waitForConnected(5000));
+
+    // the first reply is finished, closed again and kept for the next request
+    socket.write("GET /first HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    QTRY_COMPARE_WITH_TIMEOUT(parse(&socket), 1, 5000);
+    QCOMPARE(bodies.at(0), QByteArray("/first"));
+
+    // both requests are read at once and each needs a reply of its own
+    socket.write("GET /second HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                 "GET /third HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    QTRY_COMPARE_WITH_TIMEOUT(parse(&socket), 3, 5000);
+    QCOMPARE(bodies.at(1), QByteArray("/second"));
+    QCOMPARE(bodies.at(2), QByteArray("/third"));
+    QVERIFY(received.isEmpty());
+    QCOMPARE(socket.state(), QAbstractSocket::ConnectedState);
+
+    QCOMPARE(replies, 3);
+    QTRY_COMPARE(done, 3);
+}
+
+QTEST_MAIN(tst_DoubleClose)
+
+#include "main.moc"
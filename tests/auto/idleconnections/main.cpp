@@ -0,0 +1,224 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// opens tens of thousands of connections that never finish a request: half of them send
+// nothing, the other half stop in the middle of the head. every one of them has to be
+// closed by the server within its timeout and the memory they take has to stay below a
+// ceiling per connection. the client side uses plain sockets on its own thread, so only the
+// server runs Qt code
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtTest/QtTest>
+
+#include <QtHttpServer/QHttpServer>
+
+#if defined(Q_OS_UNIX)
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+static const int maxConnections = 20000;
+static const int timeout = 5000;
+// the server's timer wheel ticks every 100 msecs, a timeout may end up to a tick early.
+// accepting tens of thousands of connections delays the late ones
+static const int tick = 100;
+static const int slack = 2000;
+// peak memory of both ends of a connection, the server's socket, connection and timer
+// entry and the client's descriptor
+static const int maxBytesPerConnection = 32 * 1024;
+
+static QElapsedTimer timer;
+
+class Clients : public QThread
+{
+public:
+    Clients(quint16 port, int count) : port(port), count(count), failed(false) {}
+
+    quint16 port;
+    int count;
+    bool failed;
+    QVector<qint64> openedAt;
+    QVector<qint64> closedAt;
+
+protected:
+    void run();
+
+#if defined(Q_OS_UNIX)
+private:
+    int collect(QVector<pollfd> *fds, int msecs);
+#endif
+};
+
+#if defined(Q_OS_UNIX)
+// records the connections the server has closed, returns how many there were
+int Clients::collect(QVector<pollfd> *fds, int msecs)
+{
+    if (::poll(fds->data(), fds->size(), msecs) <= 0)
+        return 0;
+    int closed = 0;
+    char discard[4096];
+    for (int i = 0; i < fds->size(); i++) {
+        pollfd &p = (*fds)[i];
+        if (p.fd < 0 || !p.revents)
+            continue;
+        ssize_t length = ::recv(p.fd, discard, sizeof(discard), MSG_DONTWAIT);
+        if (length > 0 || (length < 0 && errno == EAGAIN))
+            continue;
+        closedAt[i] = timer.elapsed();
+        ::close(p.fd);
+        p.fd = -1;
+        closed++;
+    }
+    return closed;
+}
+#endif
+
+void Clients::run()
+{
+#if defined(Q_OS_UNIX)
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    QVector<pollfd> fds;
+    int closed = 0;
+    for (int i = 0; i < count; i++) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+            qWarning("connection %d failed: %s", i, strerror(errno));
+            if (fd >= 0)
+                ::close(fd);
+            failed = true;
+            break;
+        }
+        if (i % 2)
+            ::send(fd, "GET / HTTP/1.1\r\nHost: localhost\r\n", 33, MSG_NOSIGNAL);
+        pollfd p = { fd, POLLIN, 0 };
+        fds.append(p);
+        openedAt.append(timer.elapsed());
+        closedAt.append(-1);
+        // the first connections may time out before the last ones are open
+        if (i % 256 == 255)
+            closed += collect(&fds, 0);
+    }
+
+    // the server answers the unfinished heads with 408, the idle ones get nothing
+    qint64 deadline = timer.elapsed() + timeout + slack * 2;
+    while (closed < fds.size() && timer.elapsed() < deadline)
+        closed += collect(&fds, 100);
+    for (int i = 0; i < fds.size(); i++) {
+        if (fds[i].fd >= 0)
+            ::close(fds[i].fd);
+    }
+#endif
+}
+
+class tst_IdleConnections : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void idleConnections();
+};
+
+void tst_IdleConnections::idleConnections()
+{
+#if !defined(Q_OS_UNIX)
+    QSKIP("the clients need POSIX sockets");
+#else
+    // both ends of every connection live in this process
+    rlimit files;
+    getrlimit(RLIMIT_NOFILE, &files);
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+    getrlimit(RLIMIT_NOFILE, &files);
+    const int count = int(qMin<rlim_t>(maxConnections, (files.rlim_cur - 64) / 2));
+    QVERIFY2(count > 0, "no descriptors left for the connections");
+    if (count < maxConnections)
+        qDebug("the descriptor limit allows %d connections", count);
+
+    QHttpServer server;
+    server.setKeepAliveTimeout(timeout);
+    server.setHeaderTimeout(timeout);
+    QVERIFY(server.listen(QHostAddress::LocalHost, 0));
+
+    rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    timer.start();
+    Clients clients(server.serverPort(), count);
+    QEventLoop loop;
+    connect(&clients, &QThread::finished, &loop, &QEventLoop::quit);
+    clients.start();
+    loop.exec();
+    clients.wait();
+    rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    QVERIFY(!clients.failed);
+    QCOMPARE(clients.closedAt.size(), count);
+
+    int open = 0;
+    qint64 shortest = -1;
+    qint64 longest = 0;
+    for (int i = 0; i < clients.closedAt.size(); i++) {
+        if (clients.closedAt.at(i) < 0) {
+            open++;
+            continue;
+        }
+        qint64 lifetime = clients.closedAt.at(i) - clients.openedAt.at(i);
+        if (shortest < 0 || lifetime < shortest)
+            shortest = lifetime;
+        longest = qMax(longest, lifetime);
+    }
+    double cpu = (after.ru_utime.tv_sec - before.ru_utime.tv_sec + after.ru_stime.tv_sec - before.ru_stime.tv_sec)
+               + (after.ru_utime.tv_usec - before.ru_utime.tv_usec + after.ru_stime.tv_usec - before.ru_stime.tv_usec) / 1e6;
+    // ru_maxrss is in KiB on Linux
+    qint64 perConnection = qint64(after.ru_maxrss - before.ru_maxrss) * 1024 / count;
+    qDebug("%d connections, closed after %lld - %lld msecs, peak %lld bytes per connection, %.2f cpu secs"
+           , count, shortest, longest, perConnection, cpu);
+
+    // every timeout fired, none of them more than a tick early or later than the slack
+    QCOMPARE(open, 0);
+    QVERIFY2(shortest >= timeout - tick, qPrintable(QString::number(shortest)));
+    QVERIFY2(longest <= timeout + slack, qPrintable(QString::number(longest)));
+    QVERIFY2(perConnection <= maxBytesPerConnection, qPrintable(QString::number(perConnection)));
+#endif
+}
+
+QTEST_MAIN(tst_IdleConnections)
+
+#include "main.moc"
@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = bench_allocations
+
+QT = core network httpserver
+CONFIG += warn_on c++11 console
+CONFIG -= app_bundle
+
+SOURCES = main.cpp
@@ -0,0 +1,189 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// counts the heap allocations the server thread makes per request, for requests on one
+// keep-alive connection and for requests on a new connection each. the client runs on
+// its own thread and is not counted. only the public API is used, so the same program
+// built against an older tree gives the numbers to compare with.
+// malloc() is wrapped through glibc's __libc_ functions, other C libraries are not supported
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+#include <QtCore/QTextStream>
+#include <QtNetwork/QTcpSocket>
+
+#include <QtHttpServer/QHttpServer>
+#include <QtHttpServer/QHttpRequest>
+#include <QtHttpServer/QHttpReply>
+
+#if defined(__GLIBC__)
+#include <pthread.h>
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+static pthread_t countedThread;
+static volatile bool counting = false;
+static quint64 allocations = 0;
+
+static inline void count()
+{
+    if (counting && pthread_equal(pthread_self(), countedThread))
+        allocations++;
+}
+
+extern "C" void *malloc(size_t size)
+{
+    count();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count_, size_t size)
+{
+    count();
+    return __libc_calloc(count_, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    count();
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+static const int warmup = 200;
+static const int requests = 2000;
+
+class Client : public QThread
+{
+public:
+    explicit Client(quint16 port) : port(port), keepAlive(0), newConnection(0) {}
+
+    quint16 port;
+    double keepAlive;
+    double newConnection;
+
+protected:
+    void run();
+
+private:
+    bool request(QTcpSocket *socket, bool close);
+};
+
+// sends a request and reads its response, which has a Content-Length
+bool Client::request(QTcpSocket *socket, bool close)
+{
+    socket->write(close ? "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"
+                        : "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    QByteArray response;
+    int headEnd = -1;
+    int length = -1;
+    for (;;) {
+        if (headEnd < 0) {
+            headEnd = response.indexOf("\r\n\r\n");
+            if (headEnd >= 0) {
+                int i = response.toLower().indexOf("content-length:");
+                if (i < 0 || i > headEnd)
+                    return false;
+                length = response.mid(i + 15, response.indexOf('\r', i) - i - 15).trimmed().toInt();
+            }
+        }
+        if (headEnd >= 0 && response.size() >= headEnd + 4 + length)
+            return true;
+        if (!socket->waitForReadyRead(5000))
+            return false;
+        response += socket->readAll();
+    }
+}
+
+void Client::run()
+{
+    QTcpSocket socket;
+    socket.connectToHost(QHostAddress::LocalHost, port);
+    if (!socket.waitForConnected(5000))
+        return;
+    for (int i = 0; i < warmup; i++)
+        request(&socket, false);
+    allocations = 0;
+    counting = true;
+    for (int i = 0; i < requests; i++)
+        request(&socket, false);
+    counting = false;
+    keepAlive = double(allocations) / requests;
+    socket.disconnectFromHost();
+
+    for (int round = 0; round < 2; round++) {
+        allocations = 0;
+        counting = round == 1;
+        for (int i = 0; i < requests / 10; i++) {
+            QTcpSocket connection;
+            connection.connectToHost(QHostAddress::LocalHost, port);
+            if (!connection.waitForConnected(5000))
+                return;
+            request(&connection, true);
+            connection.waitForDisconnected(5000);
+        }
+        counting = false;
+    }
+    newConnection = double(allocations) / (requests / 10);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+#if defined(__GLIBC__)
+    countedThread = pthread_self();
+#else
+    out << "allocations can only be counted with glibc\n";
+    return 1;
+#endif
+
+    QHttpServer server;
+    QObject::connect(&server, (void (QHttpServer:: *)(QHttpRequest *, QHttpReply *))&QHttpServer::incomingConnection,
+                     [](QHttpRequest *, QHttpReply *reply) {
+        reply->setStatus(200);
+        reply->setRawHeader("Content-Type", "text/plain");
+        reply->write("ok");
+        reply->close();
+    });
+    if (!server.listen(QHostAddress::LocalHost, 0)) {
+        out << "failed to listen\n";
+        return 1;
+    }
+
+    Client client(server.serverPort());
+    QObject::connect(&client, &QThread::finished, &app, &QCoreApplication::quit);
+    client.start();
+    app.exec();
+    client.wait();
+
+    out << "allocations on the server thread per request\n"
+        << "keep-alive connection:\t" << client.keepAlive << '\n'
+        << "new connection:\t" << client.newConnection << '\n';
+    return 0;
+}
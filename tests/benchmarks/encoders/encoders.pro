@@ -0,0 +1,23 @@
+TEMPLATE = app
+TARGET = bench_encoders
+
+QT = core
+CONFIG += warn_on c++11 console
+CONFIG -= app_bundle
+
+# the encoders are not exported by the library, they are built into the benchmark
+SRC = $$PWD/../../../src/qthttpserver
+INCLUDEPATH += $$SRC
+SOURCES = main.cpp $$SRC/qhttpcompressor.cpp $$SRC/qhttpserver_logging.cpp
+
+LIBS += -lz
+
+CONFIG += link_pkgconfig
+packagesExist(libbrotlienc) {
+    DEFINES += QHS_HAVE_BROTLI
+    PKGCONFIG += libbrotlienc
+}
+packagesExist(libzstd) {
+    DEFINES += QHS_HAVE_ZSTD
+    PKGCONFIG += libzstd
+}
@@ -0,0 +1,139 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// throughput and ratio of the content encoders. a body is encoded whole like a buffered
+// reply and in 16 KiB pieces with SyncFlush like a streamed one, and small bodies measure
+// what setting up an encoder for each reply costs. the files given as arguments are used
+// as bodies, otherwise generated JSON
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include <functional>
+
+#include "qhttpcompressor_p.h"
+
+typedef std::function<QHttpContentEncoder *()> Factory;
+
+static QByteArray generatedBody(int size)
+{
+    QByteArray ret;
+    ret.reserve(size + 128);
+    ret += '[';
+    for (int i = 0; ret.size() < size; i++) {
+        ret += "{\"id\":" + QByteArray::number(i)
+                + ",\"name\":\"item " + QByteArray::number(i * 7919 % 10007)
+                + "\",\"price\":" + QByteArray::number((i * 31) % 1000) + "." + QByteArray::number(i % 100)
+                + ",\"tags\":[\"a\",\"b" + QByteArray::number(i % 13) + "\"]},";
+    }
+    ret[ret.size() - 1] = ']';
+    return ret;
+}
+
+// encodes body with one encoder and returns the size of the encoded data
+static int encode(const Factory &factory, int level, const QByteArray &body, int pieceSize)
+{
+    QHttpContentEncoder *encoder = factory();
+    QByteArray out;
+    encoder->begin(level, 0);
+    if (pieceSize <= 0) {
+        encoder->encode(body.constData(), body.size(), QHttpContentEncoder::Finish, &out);
+    } else {
+        for (int i = 0; i < body.size(); i += pieceSize)
+            encoder->encode(body.constData() + i, qMin(pieceSize, body.size() - i), QHttpContentEncoder::SyncFlush, &out);
+        encoder->encode(0, 0, QHttpContentEncoder::Finish, &out);
+    }
+    encoder->end();
+    delete encoder;
+    return out.size();
+}
+
+// MB/s over at least 200 ms
+static double throughput(const Factory &factory, int level, const QByteArray &body, int pieceSize, int *encodedSize)
+{
+    QElapsedTimer timer;
+    timer.start();
+    qint64 bytes = 0;
+    do {
+        *encodedSize = encode(factory, level, body, pieceSize);
+        bytes += body.size();
+    } while (timer.elapsed() < 200);
+    return bytes / (timer.nsecsElapsed() / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    QTextStream out(stdout);
+
+    QList<QPair<QByteArray, QByteArray> > bodies;
+    for (int i = 1; i < argc; i++) {
+        QFile file(QString::fromLocal8Bit(argv[i]));
+        if (!file.open(QIODevice::ReadOnly)) {
+            out << "can not read " << argv[i] << '\n';
+            return 1;
+        }
+        bodies.append(qMakePair(QByteArray(argv[i]), file.readAll()));
+    }
+    if (bodies.isEmpty()) {
+        bodies.append(qMakePair(QByteArray("json 1 KiB"), generatedBody(1024)));
+        bodies.append(qMakePair(QByteArray("json 64 KiB"), generatedBody(64 * 1024)));
+        bodies.append(qMakePair(QByteArray("json 1 MiB"), generatedBody(1024 * 1024)));
+    }
+
+    QList<QPair<QByteArray, Factory> > encoders;
+    encoders.append(qMakePair(QByteArray("gzip"), Factory([]() -> QHttpContentEncoder * { return new QHttpCompressor(QHttpCompressor::Gzip); })));
+    encoders.append(qMakePair(QByteArray("deflate"), Factory([]() -> QHttpContentEncoder * { return new QHttpCompressor(QHttpCompressor::Deflate); })));
+#ifdef QHS_HAVE_BROTLI
+    encoders.append(qMakePair(QByteArray("br"), Factory([]() -> QHttpContentEncoder * { return new QHttpBrotliEncoder; })));
+#endif
+#ifdef QHS_HAVE_ZSTD
+    encoders.append(qMakePair(QByteArray("zstd"), Factory([]() -> QHttpContentEncoder * { return new QHttpZstdEncoder; })));
+#endif
+    const int levels[] = { 1, -1, 9 };
+
+    out << "body\tencoding\tlevel\twhole MB/s\tratio\tstreamed MB/s\tratio\n";
+    for (int b = 0; b < bodies.size(); b++) {
+        const QByteArray &body = bodies.at(b).second;
+        for (int e = 0; e < encoders.size(); e++) {
+            for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+                int whole = 0;
+                int streamed = 0;
+                double wholeSpeed = throughput(encoders.at(e).second, levels[l], body, 0, &whole);
+                double streamedSpeed = throughput(encoders.at(e).second, levels[l], body, 16 * 1024, &streamed);
+                out << bodies.at(b).first << '\t' << encoders.at(e).first << '\t' << levels[l]
+                    << '\t' << wholeSpeed << '\t' << double(body.size()) / qMax(whole, 1)
+                    << '\t' << streamedSpeed << '\t' << double(body.size()) / qMax(streamed, 1) << '\n';
+                out.flush();
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// nanoseconds per route lookup in the radix tree of QHttpRouter for a growing number of
+// routes, against trying the patterns one after the other segment by segment like a list
+// of routes would. the targets cycle through all routes and carry parameter values and
+// a query
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QTextStream>
+#include <QtCore/QVector>
+
+#include "qhttproutetree_p.h"
+
+static QByteArray pattern(int i)
+{
+    QByteArray ret = "/api/v" + QByteArray::number(i % 8) + "/resource" + QByteArray::number(i) + "/:id";
+    if (i % 2)
+        ret += "/items/:item";
+    if (i % 10 == 0)
+        ret = "/static" + QByteArray::number(i) + "/*path";
+    return ret;
+}
+
+static QByteArray target(int i)
+{
+    QByteArray ret = "/api/v" + QByteArray::number(i % 8) + "/resource" + QByteArray::number(i) + "/" + QByteArray::number(i * 7919);
+    if (i % 2)
+        ret += "/items/" + QByteArray::number(i * 31);
+    if (i % 10 == 0)
+        ret = "/static" + QByteArray::number(i) + "/css/site.css";
+    return ret + "?page=2";
+}
+
+// a pattern as its segments, matched in the order the routes were added
+class LinearRoutes
+{
+public:
+    void add(const QByteArray &pattern) { routes.append(pattern.mid(1).split('/')); }
+
+    int find(const QByteArray &target) const
+    {
+        int query = target.indexOf('?');
+        QList<QByteArray> segments = target.mid(1, query < 0 ? -1 : query - 1).split('/');
+        for (int i = 0; i < routes.size(); i++) {
+            const QList<QByteArray> &route = routes.at(i);
+            int j = 0;
+            for (; j < route.size(); j++) {
+                if (route.at(j).startsWith('*')) {
+                    j = route.size();
+                    break;
+                }
+                if (j >= segments.size() || !(route.at(j).startsWith(':') ? !segments.at(j).isEmpty() : route.at(j) == segments.at(j)))
+                    break;
+            }
+            if (j == route.size() && (route.last().startsWith('*') || segments.size() == route.size()))
+                return i;
+        }
+        return -1;
+    }
+
+private:
+    QVector<QList<QByteArray> > routes;
+};
+
+// keeps the compiler from dropping the lookups
+static volatile int sink;
+
+template <typename Lookup>
+static double nsecsPerLookup(const QVector<QByteArray> &targets, Lookup lookup)
+{
+    QElapsedTimer timer;
+    qint64 best = -1;
+    for (int round = 0; round < 5; round++) {
+        timer.start();
+        int lookups = 0;
+        while (lookups == 0 || timer.elapsed() < 100) {
+            for (int i = 0; i < targets.size(); i++)
+                sink = lookup(targets.at(i));
+            lookups += targets.size();
+        }
+        qint64 nsecs = timer.nsecsElapsed() / lookups;
+        if (best < 0 || nsecs < best)
+            best = nsecs;
+    }
+    return best;
+}
+
+int main()
+{
+    QTextStream out(stdout);
+    out << "routes\ttree ns\tlinear ns\n";
+    const QHttpRouteTree::Handler handler = [](QHttpRequest *, QHttpReply *, const QHttpRouteTree::Parameters &) {};
+    const int counts[] = { 10, 100, 1000, 5000 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        const int count = counts[c];
+        QHttpRouteTree tree;
+        LinearRoutes linear;
+        QVector<QByteArray> targets;
+        for (int i = 0; i < count; i++) {
+            tree.insert("GET", pattern(i), handler);
+            linear.add(pattern(i));
+            targets.append(target(i));
+        }
+        // every target has to find its route in both
+        for (int i = 0; i < count; i++) {
+            QHttpRouteTree::Match m;
+            if (!tree.find("GET", targets.at(i), &m) || linear.find(targets.at(i)) != i) {
+                out << "no route for " << targets.at(i) << '\n';
+                return 1;
+            }
+        }
+
+        out << count
+            << '\t' << nsecsPerLookup(targets, [&tree](const QByteArray &t) {
+                   QHttpRouteTree::Match m;
+                   const QHttpRouteTree::Route *route = tree.find("GET", t, &m);
+                   return int(m.captures.size()) + (route ? 1 : 0);
+               })
+            << '\t' << nsecsPerLookup(targets, [&linear](const QByteArray &t) { return linear.find(t); })
+            << '\n';
+        out.flush();
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = bench_router
+
+QT = core
+CONFIG += warn_on c++11 console
+CONFIG -= app_bundle
+
+# the route tree is not exported by the library, it is built into the benchmark
+SRC = $$PWD/../../../src/qthttpserver
+INCLUDEPATH += $$SRC
+SOURCES = main.cpp $$SRC/qhttproutetree.cpp $$SRC/qhttpscan.cpp $$SRC/qhttpserver_logging.cpp
@@ -0,0 +1,128 @@
+/* Copyright (c) 2012 QtHttpServer Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the QtHttpServer nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL QTHTTPSERVER BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// bytes per cycle of qhsFindChar() and qhsFindString() against plain byte loops. the
+// needle sits at the end of the buffer, so every byte is scanned. on x86 cycles are read
+// with rdtsc, elsewhere nanoseconds are reported instead
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTextStream>
+
+#include "qhttpscan_p.h"
+
+#include <string.h>
+
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_MSVC))
+#  include <x86intrin.h>
+#  define HAVE_RDTSC
+#endif
+
+static quint64 ticks()
+{
+#if defined(HAVE_RDTSC)
+    return __rdtsc();
+#else
+    static QElapsedTimer timer;
+    if (!timer.isValid())
+        timer.start();
+    return timer.nsecsElapsed();
+#endif
+}
+
+static const char *findCharLoop(const char *begin, const char *end, char c)
+{
+    while (begin < end && *begin != c)
+        begin++;
+    return begin;
+}
+
+static const char *findStringLoop(const char *begin, const char *end, const char *needle, int needleLength)
+{
+    for (const char *p = begin; p + needleLength <= end; p++) {
+        if (memcmp(p, needle, needleLength) == 0)
+            return p;
+    }
+    return end;
+}
+
+// keeps the compiler from dropping the scans
+static volatile quintptr sink;
+
+template <typename Scan>
+static double bytesPerTick(int size, Scan scan)
+{
+    const int iterations = qMax(1000, (64 << 20) / size);
+    quint64 best = ~quint64(0);
+    for (int round = 0; round < 5; round++) {
+        quint64 start = ticks();
+        for (int i = 0; i < iterations; i++)
+            sink = quintptr(scan());
+        best = qMin(best, ticks() - start);
+    }
+    return double(size) * iterations / qMax<quint64>(best, 1);
+}
+
+int main()
+{
+    QTextStream out(stdout);
+#if defined(HAVE_RDTSC)
+    out << "bytes/cycle\n";
+#else
+    out << "bytes/ns\n";
+#endif
+    out << "size\tfindChar\tloop\tmemchr\tfindString\tloop\n";
+
+    static const char delimiter[] = "\r\n--boundary";
+    const int delimiterLength = sizeof(delimiter) - 1;
+    const int sizes[] = { 16, 64, 256, 1024, 4096, 65536 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        const int size = sizes[i];
+        // header-like text without the needle up to the end
+        QByteArray buffer(size, 'a');
+        for (int j = 0; j < size; j++)
+            buffer[j] = "GET /index.html HTTP/1.1 Host: example.com\r"[j % 43];
+        buffer[size - 1] = '\n';
+        const char *begin = buffer.constData();
+        const char *end = begin + size;
+
+        QByteArray text(size, 'x');
+        if (size >= delimiterLength)
+            memcpy(text.data() + size - delimiterLength, delimiter, delimiterLength);
+        const char *textBegin = text.constData();
+        const char *textEnd = textBegin + size;
+
+        out << size
+            << '\t' << bytesPerTick(size, [=]() { return qhsFindChar(begin, end, '\n'); })
+            << '\t' << bytesPerTick(size, [=]() { return findCharLoop(begin, end, '\n'); })
+            << '\t' << bytesPerTick(size, [=]() { return static_cast<const char *>(memchr(begin, '\n', end - begin)); })
+            << '\t' << bytesPerTick(size, [=]() { return qhsFindString(textBegin, textEnd, delimiter, delimiterLength); })
+            << '\t' << bytesPerTick(size, [=]() { return findStringLoop(textBegin, textEnd, delimiter, delimiterLength); })
+            << '\n';
+        out.flush();
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = bench_scan
+
+QT = core
+CONFIG += warn_on c++11 console
+CONFIG -= app_bundle
+
+# the scanner is not exported by the library, it is built into the benchmark
+SRC = $$PWD/../../../src/qthttpserver
+INCLUDEPATH += $$SRC
+SOURCES = main.cpp $$SRC/qhttpscan.cpp